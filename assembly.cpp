@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cmath>
+
+#include "assembly.h"
+#include "parallel.h"
+
+using namespace std;
+
+void Assembly::assemble(int bspline_cnt, int thread_cnt, CsrMatrix *mass, CsrMatrix *stiffness) {
+	compute_quadrature();
+	compute_basis_tables(thread_cnt);
+
+	// Pieces of each B-spline, in ascending order of their cells.
+	bspline_piece_offsets.assign(bspline_cnt + 1, 0);
+	int piece_cnt = piece_cells.size();
+	for (int piece = 0; piece < piece_cnt; piece++)
+		bspline_piece_offsets[polynomials.get_bspline(piece) + 1]++;
+	for (int i = 0; i < bspline_cnt; i++)
+		bspline_piece_offsets[i + 1] += bspline_piece_offsets[i];
+	bspline_pieces.resize(piece_cnt);
+	vector<int> next(bspline_piece_offsets.begin(), bspline_piece_offsets.end() - 1);
+	for (int piece = 0; piece < piece_cnt; piece++)
+		bspline_pieces[next[polynomials.get_bspline(piece)]++] = piece;
+
+	compute_sparsity(bspline_cnt, mass);
+	mass->values.assign(mass->get_nonzero_count(), 0.0);
+	*stiffness = *mass;
+
+	parallel_for(bspline_cnt, thread_cnt, [&](int from, int to) {
+		for (int row = from; row < to; row++)
+			assemble_row(row, mass, stiffness);
+	});
+}
+
+// Roots of the Legendre polynomial of degree n, found by Newton's method,
+// with the matching weights; exact for polynomials of degree up to 2n - 1,
+// such as products of two pieces.
+void Assembly::compute_quadrature() {
+	int n = polynomials.get_degree() + 1;
+	points.resize(n);
+	weights.resize(n);
+	for (int i = 0; i < n; i++) {
+		double t = cos(M_PI * (i + 0.75) / (n + 0.5));
+		double derivative = 0.0;
+		for (int iteration = 0; iteration < 100; iteration++) {
+			// Legendre polynomials by the three-term recurrence.
+			double p0 = 1.0, p1 = t;
+			for (int k = 2; k <= n; k++) {
+				double p2 = ((2 * k - 1) * t * p1 - (k - 1) * p0) / k;
+				p0 = p1;
+				p1 = p2;
+			}
+			derivative = n * (t * p1 - p0) / (t * t - 1);
+			double step = p1 / derivative;
+			t -= step;
+			if (fabs(step) < 1e-16)
+				break;
+		}
+		// Mapped from [-1, 1] onto [0, 1].
+		points[i] = (1.0 - t) / 2;
+		weights[i] = 1.0 / ((1 - t * t) * derivative * derivative);
+	}
+}
+
+void Assembly::compute_basis_tables(int thread_cnt) {
+	int n = polynomials.get_degree() + 1;
+	int q_cnt = points.size() * points.size();
+	int cell_cnt = polynomials.get_cell_count();
+	int piece_cnt = polynomials.get_piece_count();
+	piece_cells.resize(piece_cnt);
+	values.resize(piece_cnt * q_cnt);
+	x_derivatives.resize(piece_cnt * q_cnt);
+	y_derivatives.resize(piece_cnt * q_cnt);
+
+	// Powers of the points and their derivatives, the same for all cells.
+	int point_cnt = points.size();
+	vector<double> powers(point_cnt * n), derivative_powers(point_cnt * n);
+	for (int a = 0; a < point_cnt; a++)
+		for (int i = 0; i < n; i++) {
+			powers[a * n + i] = pow(points[a], i);
+			derivative_powers[a * n + i] = i > 0 ? i * pow(points[a], i - 1) : 0.0;
+		}
+
+	parallel_for(cell_cnt, thread_cnt, [&](int from, int to) {
+		for (int cell = from; cell < to; cell++) {
+			const double *box = polynomials.get_cell_box(cell);
+			double width = box[1] - box[0], height = box[3] - box[2];
+			for (int piece = polynomials.get_pieces_begin(cell); piece < polynomials.get_pieces_end(cell); piece++) {
+				piece_cells[piece] = cell;
+				const double *c = polynomials.get_coefs(piece);
+				for (int a = 0; a < point_cnt; a++)
+					for (int b = 0; b < point_cnt; b++) {
+						const double *u = &powers[a * n], *du = &derivative_powers[a * n];
+						const double *v = &powers[b * n], *dv = &derivative_powers[b * n];
+						double value = 0.0, du_value = 0.0, dv_value = 0.0;
+						for (int i = 0; i < n; i++)
+							for (int j = 0; j < n; j++) {
+								value += c[i * n + j] * u[i] * v[j];
+								du_value += c[i * n + j] * du[i] * v[j];
+								dv_value += c[i * n + j] * u[i] * dv[j];
+							}
+						double scale = sqrt(weights[a] * weights[b] * width * height);
+						int q = piece * q_cnt + a * point_cnt + b;
+						values[q] = scale * value;
+						x_derivatives[q] = scale * du_value / width;
+						y_derivatives[q] = scale * dv_value / height;
+					}
+			}
+		}
+	});
+}
+
+// B-splines i and j interact wherever they share a cell.
+void Assembly::compute_sparsity(int bspline_cnt, CsrMatrix *pattern) const {
+	pattern->row_cnt = pattern->column_cnt = bspline_cnt;
+	pattern->row_offsets.assign(1, 0);
+	pattern->columns.clear();
+	vector<int> row_columns;
+	for (int row = 0; row < bspline_cnt; row++) {
+		row_columns.clear();
+		for (int k = bspline_piece_offsets[row]; k < bspline_piece_offsets[row + 1]; k++) {
+			int cell = piece_cells[bspline_pieces[k]];
+			for (int other = polynomials.get_pieces_begin(cell); other < polynomials.get_pieces_end(cell); other++)
+				row_columns.push_back(polynomials.get_bspline(other));
+		}
+		sort(row_columns.begin(), row_columns.end());
+		row_columns.erase(unique(row_columns.begin(), row_columns.end()), row_columns.end());
+		pattern->columns.insert(pattern->columns.end(), row_columns.begin(), row_columns.end());
+		pattern->row_offsets.push_back(pattern->columns.size());
+	}
+}
+
+void Assembly::assemble_row(int row, CsrMatrix *mass, CsrMatrix *stiffness) const {
+	int q_cnt = points.size() * points.size();
+	for (int k = bspline_piece_offsets[row]; k < bspline_piece_offsets[row + 1]; k++) {
+		int piece = bspline_pieces[k];
+		int cell = piece_cells[piece];
+		for (int other = polynomials.get_pieces_begin(cell); other < polynomials.get_pieces_end(cell); other++) {
+			double mass_sum = 0.0, stiffness_sum = 0.0;
+			for (int q = 0; q < q_cnt; q++) {
+				int p = piece * q_cnt + q, o = other * q_cnt + q;
+				mass_sum += values[p] * values[o];
+				stiffness_sum += x_derivatives[p] * x_derivatives[o] + y_derivatives[p] * y_derivatives[o];
+			}
+			int pos = mass->find(row, polynomials.get_bspline(other));
+			mass->values[pos] += mass_sum;
+			stiffness->values[pos] += stiffness_sum;
+		}
+	}
+}
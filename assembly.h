@@ -0,0 +1,46 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_ASSEMBLY_H
+#define BSPLINE_SINGULARITIES_GALOIS_ASSEMBLY_H
+
+#include "csr-matrix.h"
+#include "element-polynomials.h"
+
+// Assembles the mass (integrals of B_i B_j) and stiffness (integrals of
+// grad B_i . grad B_j) matrices of the domain's B-splines, integrating their
+// pieces over each cell of each element with Gauss-Legendre quadrature exact
+// for them.
+//
+// Each B-spline's row is assembled on its own, going through the cells its
+// pieces lie on in ascending order, so threads owning different rows never
+// write the same entry and the sums do not depend on the thread count.
+class Assembly {
+public:
+
+	Assembly(const ElementPolynomials &_polynomials):
+		polynomials(_polynomials) {
+	}
+
+	void assemble(int bspline_cnt, int thread_cnt, CsrMatrix *mass, CsrMatrix *stiffness);
+
+private:
+
+	void compute_quadrature();
+
+	void compute_basis_tables(int thread_cnt);
+
+	void compute_sparsity(int bspline_cnt, CsrMatrix *pattern) const;
+
+	void assemble_row(int row, CsrMatrix *mass, CsrMatrix *stiffness) const;
+
+	const ElementPolynomials &polynomials;
+
+	// Gauss-Legendre points and weights within [0, 1], in each dimension.
+	vector<double> points, weights;
+	// At each quadrature point of each piece's cell: its value, and its x and
+	// y derivatives, each multiplied by the square root of the point's weight
+	// times the cell's area, so that products of two sum up to integrals.
+	vector<double> values, x_derivatives, y_derivatives;
+	// Pieces of each B-spline, packed one list after another.
+	vector<int> bspline_piece_offsets, bspline_pieces, piece_cells;
+};
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_ASSEMBLY_H
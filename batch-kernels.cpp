@@ -0,0 +1,185 @@
+#include <stdexcept>
+#include <string>
+#include "batch-kernels.h"
+
+using namespace std;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+
+/*** B-SPLINES ***/
+
+// Same recursion as in Bspline::apply_1d, with the branches turned into
+// selects: dividing by 1 instead of a zero denominator keeps the discarded
+// term finite.
+template <int ORDER>
+static inline __attribute__((always_inline))
+void bspline_1d_batch_of_order(const double* knots, const double* points, double* out, int cnt) {
+	for (int i = 0; i < cnt; i++) {
+		double point = points[i];
+		double values[ORDER + 1];
+		#pragma GCC unroll 8
+		for (int b = 0; b <= ORDER; b++)
+			values[b] = (knots[b] <= point ? 1.0 : 0.0) * (point < knots[b+1] ? 1.0 : 0.0);
+
+		#pragma GCC unroll 8
+		for (int o = 1; o <= ORDER; o++) {
+			#pragma GCC unroll 8
+			for (int b = 0; b <= ORDER-o; b++) {
+				double left_den  = knots[b+o] - knots[b];
+				double right_den = knots[b+o+1] - knots[b+1];
+				double left  = (point - knots[b]) / (left_den != 0.0 ? left_den : 1.0) * values[b];
+				double right = (knots[b+o+1] - point) / (right_den != 0.0 ? right_den : 1.0) * values[b+1];
+				values[b] = (left_den != 0.0 ? left : 0.0) + (right_den != 0.0 ? right : 0.0);
+			}
+		}
+		out[i] = values[0];
+	}
+}
+
+SIMD_CLONES
+void bspline_1d_batch(const double* knots, int order, const double* points, double* out, int cnt) {
+	switch (order) {
+		case 0: bspline_1d_batch_of_order<0>(knots, points, out, cnt); break;
+		case 1: bspline_1d_batch_of_order<1>(knots, points, out, cnt); break;
+		case 2: bspline_1d_batch_of_order<2>(knots, points, out, cnt); break;
+		case 3: bspline_1d_batch_of_order<3>(knots, points, out, cnt); break;
+		case 4: bspline_1d_batch_of_order<4>(knots, points, out, cnt); break;
+		default: throw invalid_argument("unsupported B-spline order " + to_string(order));
+	}
+}
+
+// num / den, or 0 where den is 0.
+static inline __attribute__((always_inline))
+double safe_quotient(double num, double den) {
+	double quotient = num / (den != 0.0 ? den : 1.0);
+	return den != 0.0 ? quotient : 0.0;
+}
+
+// The same recursion again, keeping the bases of all the orders: the first
+// derivative of the B-spline follows from the two of order ORDER - 1, and the
+// second from the three of order ORDER - 2.
+template <int ORDER>
+static inline __attribute__((always_inline))
+void bspline_1d_derivatives_batch_of_order(const double* knots, const double* points,
+		double* values, double* firsts, double* seconds, int cnt) {
+	for (int i = 0; i < cnt; i++) {
+		double point = points[i];
+		double bases[ORDER + 1][ORDER + 1];
+		#pragma GCC unroll 8
+		for (int b = 0; b <= ORDER; b++)
+			bases[0][b] = (knots[b] <= point ? 1.0 : 0.0) * (point < knots[b+1] ? 1.0 : 0.0);
+
+		#pragma GCC unroll 8
+		for (int o = 1; o <= ORDER; o++) {
+			#pragma GCC unroll 8
+			for (int b = 0; b <= ORDER-o; b++) {
+				double left_den  = knots[b+o] - knots[b];
+				double right_den = knots[b+o+1] - knots[b+1];
+				double left  = (point - knots[b]) / (left_den != 0.0 ? left_den : 1.0) * bases[o-1][b];
+				double right = (knots[b+o+1] - point) / (right_den != 0.0 ? right_den : 1.0) * bases[o-1][b+1];
+				bases[o][b] = (left_den != 0.0 ? left : 0.0) + (right_den != 0.0 ? right : 0.0);
+			}
+		}
+		values[i] = bases[ORDER][0];
+
+		// B'_{b,p} = p B_{b,p-1} / (t_{b+p} - t_b) - p B_{b+1,p-1} / (t_{b+p+1} - t_{b+1})
+		// (lower orders clamped, so that unused branches index within bounds)
+		const int p = ORDER, p1 = p >= 1 ? p - 1 : 0, p2 = p >= 2 ? p - 2 : 0;
+		double first = 0.0, second = 0.0;
+		if (p >= 1)
+			first = p * (safe_quotient(bases[p1][0], knots[p] - knots[0])
+					- safe_quotient(bases[p1][1], knots[p+1] - knots[1]));
+		if (p >= 2) {
+			double lower_first[2];
+			#pragma GCC unroll 8
+			for (int b = 0; b < 2; b++)
+				lower_first[b] = (p - 1) * (safe_quotient(bases[p2][b], knots[b+p-1] - knots[b])
+						- safe_quotient(bases[p2][b+1], knots[b+p] - knots[b+1]));
+			second = p * (safe_quotient(lower_first[0], knots[p] - knots[0])
+					- safe_quotient(lower_first[1], knots[p+1] - knots[1]));
+		}
+		firsts[i] = first;
+		seconds[i] = second;
+	}
+}
+
+SIMD_CLONES
+void bspline_1d_derivatives_batch(const double* knots, int order, const double* points,
+		double* values, double* firsts, double* seconds, int cnt) {
+	switch (order) {
+		case 0: bspline_1d_derivatives_batch_of_order<0>(knots, points, values, firsts, seconds, cnt); break;
+		case 1: bspline_1d_derivatives_batch_of_order<1>(knots, points, values, firsts, seconds, cnt); break;
+		case 2: bspline_1d_derivatives_batch_of_order<2>(knots, points, values, firsts, seconds, cnt); break;
+		case 3: bspline_1d_derivatives_batch_of_order<3>(knots, points, values, firsts, seconds, cnt); break;
+		case 4: bspline_1d_derivatives_batch_of_order<4>(knots, points, values, firsts, seconds, cnt); break;
+		default: throw invalid_argument("unsupported B-spline order " + to_string(order));
+	}
+}
+
+SIMD_CLONES
+void scaled_product_batch(double constant, const double* first, const double* second, double* out, int cnt) {
+	for (int i = 0; i < cnt; i++)
+		out[i] = constant * first[i] * second[i];
+}
+
+SIMD_CLONES
+void outer_product_grid(double constant, const double* firsts, int x_cnt, const double* seconds, int y_cnt,
+		double* out) {
+	for (int xi = 0; xi < x_cnt; xi++) {
+		double scaled_first = constant * firsts[xi];
+		double* row = out + xi * y_cnt;
+		for (int yi = 0; yi < y_cnt; yi++)
+			row[yi] = scaled_first * seconds[yi];
+	}
+}
+
+
+/*** OTHER FUNCTIONS ***/
+
+SIMD_CLONES
+void linear_batch(double a, double b, double c, const double* xs, const double* ys, double* out, int cnt) {
+	for (int i = 0; i < cnt; i++)
+		out[i] = a * xs[i] + b * ys[i] + c;
+}
+
+SIMD_CLONES
+void zero_rect_batch(double x_from, double x_to, double y_from, double y_to, bool inside,
+		const double* xs, const double* ys, double* out, int cnt) {
+	for (int i = 0; i < cnt; i++) {
+		bool in_rect = (x_from <= xs[i]) & (xs[i] <= x_to) & (y_from <= ys[i]) & (ys[i] <= y_to);
+		out[i] = in_rect == inside ? 0.0 : out[i];
+	}
+}
+
+SIMD_CLONES
+void zero_rect_grid(double x_from, double x_to, double y_from, double y_to, bool inside,
+		const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) {
+	for (int xi = 0; xi < x_cnt; xi++) {
+		bool x_in = (x_from <= xs[xi]) & (xs[xi] <= x_to);
+		double* row = out + xi * y_cnt;
+		for (int yi = 0; yi < y_cnt; yi++) {
+			bool in_rect = x_in & (y_from <= ys[yi]) & (ys[yi] <= y_to);
+			row[yi] = in_rect == inside ? 0.0 : row[yi];
+		}
+	}
+}
+
+SIMD_CLONES
+void add_scaled_batch(const double* values, double coef, double* out, int cnt) {
+	for (int i = 0; i < cnt; i++)
+		out[i] += values[i] * coef;
+}
+
+SIMD_CLONES
+void quotient_batch(const double* dividends, const double* divisors, double* out, int cnt) {
+	for (int i = 0; i < cnt; i++) {
+		double divisor = divisors[i];
+		double quotient = dividends[i] / (divisor != 0.0 ? divisor : 1.0);
+		out[i] = divisor != 0.0 ? quotient : 0.0;
+	}
+}
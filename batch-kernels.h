@@ -0,0 +1,50 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_BATCHKERNELS_H
+#define BSPLINE_SINGULARITIES_GALOIS_BATCHKERNELS_H
+
+// Loops evaluating functions over arrays of points, written so that they are
+// vectorized. On x86-64 each of them is compiled for AVX-512 and AVX2 as well
+// as for the baseline, the best one picked for the CPU at load time. As they
+// are built without fusing multiplications and additions (see the Makefile),
+// they compute exactly what the one-point versions do, to the last bit, which
+// `check-batch' verifies.
+
+// Number of points which Function2D::apply_batch implementations keep in
+// their temporary buffers at a time.
+const int BATCH_SIZE = 256;
+
+// Values of a 1D B-spline of the given order (up to 4) over order + 2 knots,
+// throwing invalid_argument for any other order.
+void bspline_1d_batch(const double* knots, int order, const double* points, double* out, int cnt);
+
+// Values of a 1D B-spline as in bspline_1d_batch, together with its first and
+// second derivatives.
+void bspline_1d_derivatives_batch(const double* knots, int order, const double* points,
+		double* values, double* firsts, double* seconds, int cnt);
+
+// out[i] = constant * first[i] * second[i]
+void scaled_product_batch(double constant, const double* first, const double* second, double* out, int cnt);
+
+// out[xi * y_cnt + yi] = constant * firsts[xi] * seconds[yi]
+void outer_product_grid(double constant, const double* firsts, int x_cnt, const double* seconds, int y_cnt,
+		double* out);
+
+// out[i] = a * xs[i] + b * ys[i] + c
+void linear_batch(double a, double b, double c, const double* xs, const double* ys, double* out, int cnt);
+
+// Zeroes out[i] wherever (xs[i], ys[i]) lies outside (or, if `inside',
+// inside) of the closed rectangle.
+void zero_rect_batch(double x_from, double x_to, double y_from, double y_to, bool inside,
+		const double* xs, const double* ys, double* out, int cnt);
+
+// zero_rect_batch over the grid of points (xs[xi], ys[yi]), laid out as in
+// outer_product_grid.
+void zero_rect_grid(double x_from, double x_to, double y_from, double y_to, bool inside,
+		const double* xs, int x_cnt, const double* ys, int y_cnt, double* out);
+
+// out[i] += values[i] * coef
+void add_scaled_batch(const double* values, double coef, double* out, int cnt);
+
+// out[i] = dividends[i] / divisors[i], or 0 where the divisor is 0.
+void quotient_batch(const double* dividends, const double* divisors, double* out, int cnt);
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_BATCHKERNELS_H
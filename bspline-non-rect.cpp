@@ -1,9 +1,10 @@
 
 #include <algorithm>
-#include <fstream>
+#include "batch-kernels.h"
 #include "bspline-non-rect.h"
 #include "bspline.h"
 #include "cube.h"
+#include "mesh.h"
 
 double BsplineNonRect::apply(double x, double y) const {
 	double x_min = min(not_defined[0], not_defined[1]);
@@ -18,6 +19,28 @@ double BsplineNonRect::apply(double x, double y) const {
 	}
 }
 
+void BsplineNonRect::apply_batch(const double* xs, const double* ys, double* out, int cnt) const {
+	Bspline::apply_batch(xs, ys, out, cnt);
+	zero_rect_batch(
+			min(not_defined[0], not_defined[1]), max(not_defined[0], not_defined[1]),
+			min(not_defined[2], not_defined[3]), max(not_defined[2], not_defined[3]),
+			true, xs, ys, out, cnt);
+}
+
+void BsplineNonRect::apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const {
+	Bspline::apply_grid(xs, x_cnt, ys, y_cnt, out);
+	zero_rect_grid(
+			min(not_defined[0], not_defined[1]), max(not_defined[0], not_defined[1]),
+			min(not_defined[2], not_defined[3]), max(not_defined[2], not_defined[3]),
+			true, xs, x_cnt, ys, y_cnt, out);
+}
+
+void BsplineNonRect::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const {
+	Bspline::apply_derivatives_batch(xs, ys, out, cnt);
+	zero_derivatives_batch(Rect(not_defined[0], not_defined[1], not_defined[2], not_defined[3]),
+			true, xs, ys, out, cnt);
+}
+
 BsplineNonRect GnomonBspline::make_trunk(const GnomonBsplineCoords& c) {
 	return BsplineNonRect(
 			{ c.x_from(), c.x_mid, c.x_mid, c.x_to() },
@@ -67,49 +90,26 @@ LinearFunction GlueFunction::make_fix_unconstrained(const GnomonBsplineCoords& c
 	);
 }
 
-void read_vector(ifstream& in, vector<double>* out, int cnt) {
-	for (int i = 0; i < cnt; i++) {
-		double x;
-		in >> x;
-		out->push_back(x);
-	}
-}
-
+// The same mesh and B-splines as those of `generate --knots <depth>'.
 NurbsOverAdaptedGrid::NurbsOverAdaptedGrid(int depth) {
-	string d = to_string(depth);
-	string grid_file = "grid-" + d + ".dat";
-	string cmd = "./generate --knots " + d + " > " + grid_file;
-	system(cmd.c_str());
-	ifstream fin(grid_file);
-
-	int N; // number of elements
-	fin >> N;
-	for (int i = 0; i < N; i++) {
-		Bounds b;
-		fin >> b.left >> b.right >> b.up >> b.down;
-	}
-
-	int M; // number of B-splines
-	fin >> M;
-	for (int i = 0; i < M; i++) {
-		string type;
-		// Regular or Gnomon
-		fin >> type;
-		if (type == "Regular") {
-			vector<double> x_knots, y_knots;
-			read_vector(fin, &x_knots, 4);
-			read_vector(fin, &y_knots, 4);
-			Bspline* regular = new Bspline(x_knots, y_knots);
-			unscaled_bsplines.push_back(regular);
-		} else {  // type == "Gnomon"
-			double x_mid, y_mid, shift_x, shift_y;
-			fin >> x_mid >> y_mid >> shift_x >> shift_y;
-			GnomonBspline* gnomon = new GnomonBspline(x_mid, y_mid, shift_x, shift_y);
-			unscaled_bsplines.push_back(gnomon);
-		}
+	Coord size = 2L << depth;
+	domain = new Domain(get_outmost_box(size, QUADRATIC));
+	build_adapted_mesh(*domain, EDGED_4, QUADRATIC, depth, size);
+	domain->compute_bsplines_supports(EDGED_4, 2);
+	for (const BsplineChoice& choice: domain->get_bsplines()) {
+		if (choice.regular != nullptr)
+			unscaled_bsplines.push_back(choice.regular);
+		else
+			unscaled_bsplines.push_back(choice.gnomon);
 	}
 
-	LinearCombination* sum_of_unscaled = new LinearCombination(unscaled_bsplines);
+	// B-splines supported at a point are those of the element containing it.
+	vector<Rect> supports;
+	for (unsigned i = 0; i < unscaled_bsplines.size(); i++)
+		supports.push_back(get_bspline_support(i));
+	locator = new DomainBsplineLocator(*domain);
+	sum_of_unscaled = new CulledLinearCombination(unscaled_bsplines, supports,
+			vector<double>(unscaled_bsplines.size(), 1.0), locator);
 	for (const Function2D* unscaled_bspline: unscaled_bsplines) {
 		const GnomonBspline* gb = dynamic_cast<const GnomonBspline*>(unscaled_bspline);
 		Quotient* scaled_bspline;
@@ -121,3 +121,95 @@ NurbsOverAdaptedGrid::NurbsOverAdaptedGrid(int depth) {
 	}
 }
 
+void NurbsOverAdaptedGrid::apply_all(double x, double y, vector<int>* indices, vector<double>* values) const {
+	sum_of_unscaled->find_candidates(x, y, indices);
+	values->resize(indices->size());
+	// The divisor summed the way CulledLinearCombination::apply does.
+	double divisor_value = 0.0;
+	for (unsigned k = 0; k < indices->size(); k++) {
+		int i = (*indices)[k];
+		(*values)[k] = sum_of_unscaled->get_function(i).apply(x, y);
+		divisor_value += (*values)[k] * sum_of_unscaled->get_coef(i);
+	}
+
+	unsigned nonzero_cnt = 0;
+	for (unsigned k = 0; k < indices->size(); k++) {
+		double value = divisor_value != 0.0 ? (*values)[k] / divisor_value : 0.0;
+		if (value != 0.0) {
+			(*indices)[nonzero_cnt] = (*indices)[k];
+			(*values)[nonzero_cnt] = value;
+			nonzero_cnt++;
+		}
+	}
+	indices->resize(nonzero_cnt);
+	values->resize(nonzero_cnt);
+}
+
+double NurbsSum::apply(double x, double y) const {
+	double result;
+	apply_batch(&x, &y, &result, 1);
+	return result;
+}
+
+void NurbsSum::apply_batch(const double* xs, const double* ys, double* out, int cnt) const {
+	vector<int> indices;
+	vector<double> values;
+	for (int i = 0; i < cnt; i++) {
+		nurbs.apply_all(xs[i], ys[i], &indices, &values);
+		out[i] = 0.0;
+		for (double value: values)
+			out[i] += value;
+	}
+}
+
+CsrMatrix NurbsOverAdaptedGrid::get_collocation_matrix(const double* xs, const double* ys, int cnt) const {
+	CsrMatrix matrix;
+	matrix.row_cnt = cnt;
+	matrix.column_cnt = unscaled_bsplines.size();
+	vector<int> indices;
+	vector<double> values;
+	for (int i = 0; i < cnt; i++) {
+		apply_all(xs[i], ys[i], &indices, &values);
+		matrix.columns.insert(matrix.columns.end(), indices.begin(), indices.end());
+		matrix.values.insert(matrix.values.end(), values.begin(), values.end());
+		matrix.row_offsets.push_back(matrix.columns.size());
+	}
+	return matrix;
+}
+
+void NurbsOverAdaptedGrid::apply_all_derivatives(double x, double y, vector<int>* indices,
+		vector<Derivatives>* values) const {
+	sum_of_unscaled->find_candidates(x, y, indices);
+	values->resize(indices->size());
+	Derivatives divisor = ZERO_DERIVATIVES;
+	for (unsigned k = 0; k < indices->size(); k++) {
+		int i = (*indices)[k];
+		sum_of_unscaled->get_function(i).apply_derivatives_batch(&x, &y, &(*values)[k], 1);
+		divisor.add_scaled((*values)[k], sum_of_unscaled->get_coef(i));
+	}
+
+	unsigned nonzero_cnt = 0;
+	for (unsigned k = 0; k < indices->size(); k++) {
+		Derivatives scaled = divide_derivatives((*values)[k], divisor);
+		// A zero value may still come with a nonzero gradient, as on the
+		// boundary of a support.
+		if (!scaled.is_zero()) {
+			(*indices)[nonzero_cnt] = (*indices)[k];
+			(*values)[nonzero_cnt] = scaled;
+			nonzero_cnt++;
+		}
+	}
+	indices->resize(nonzero_cnt);
+	values->resize(nonzero_cnt);
+}
+
+void NurbsSum::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const {
+	vector<int> indices;
+	vector<Derivatives> values;
+	for (int i = 0; i < cnt; i++) {
+		nurbs.apply_all_derivatives(xs[i], ys[i], &indices, &values);
+		out[i] = ZERO_DERIVATIVES;
+		for (const Derivatives& value: values)
+			out[i].add_scaled(value, 1.0);
+	}
+}
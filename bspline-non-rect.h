@@ -1,5 +1,6 @@
 
 #include "bspline.h"
+#include "csr-matrix.h"
 #include "cube.h"
 #include "linear-combination.h"
 
@@ -16,6 +17,12 @@ public:
 
     double apply(double x, double y) const;
 
+    void apply_batch(const double* xs, const double* ys, double* out, int cnt) const;
+
+    void apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const;
+
+    void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
 private:
     // not_defined vector says where BsplineNonRect is equal 0, its length is always 4: {left, up, right, down}
     vector<double> not_defined;
@@ -98,6 +105,7 @@ public:
 			glue(c) {
     }
 
+	const GnomonBsplineCoords& get_coords() const { return coords; }
 	double get_x_mid() const { return coords.x_mid; }
 	double get_y_mid() const { return coords.y_mid; }
 	double get_shift_x() const { return coords.shift_x; }
@@ -226,6 +234,10 @@ private:
 	Quotient trunk, x_shifted, y_shifted, glue;
 };
 
+class Domain;
+class DomainBsplineLocator;
+
+// Rational B-splines over the mesh of the given depth, built in memory.
 class NurbsOverAdaptedGrid {
 public:
 	NurbsOverAdaptedGrid(int depth);
@@ -238,6 +250,21 @@ public:
 		return scaled_bsplines;
 	}
 
+	// Puts positions and values of all the scaled B-splines nonzero at the
+	// point into `indices' and `values', in ascending order of positions. Each
+	// of the supported B-splines is evaluated once, also to compute the
+	// divisor shared by all of them.
+	void apply_all(double x, double y, vector<int>* indices, vector<double>* values) const;
+
+	// Values of all the scaled B-splines at each of the points (xs[i], ys[i]),
+	// one row per point and one column per B-spline, looking up the B-splines
+	// supported at each point rather than evaluating all of them.
+	CsrMatrix get_collocation_matrix(const double* xs, const double* ys, int cnt) const;
+
+	// The same as apply_all, for the values together with their derivatives,
+	// leaving out only the B-splines whose derivatives are all zero as well.
+	void apply_all_derivatives(double x, double y, vector<int>* indices, vector<Derivatives>* values) const;
+
 	Rect get_bspline_support(int index) {
 		Bspline* regular = dynamic_cast<Bspline*>(unscaled_bsplines[index]);
 		if (regular != nullptr)
@@ -246,7 +273,28 @@ public:
 	}
 
 private:
+	Domain* domain;
+	DomainBsplineLocator* locator;
 	vector<Function2D*> unscaled_bsplines, scaled_bsplines;
+	CulledLinearCombination* sum_of_unscaled;
+};
+
+// Sum of all the scaled B-splines of the grid, the same as a LinearCombination
+// of them but with each unscaled B-spline evaluated once per point.
+class NurbsSum : public Function2D {
+public:
+	NurbsSum(const NurbsOverAdaptedGrid& _nurbs):
+		nurbs(_nurbs) {
+	}
+
+	double apply(double x, double y) const;
+
+	void apply_batch(const double* xs, const double* ys, double* out, int cnt) const;
+
+	void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
+private:
+	const NurbsOverAdaptedGrid& nurbs;
 };
 
 #endif //BSPLINE_SINGULARITIES_GALOIS_BSPLINENONRECT_H
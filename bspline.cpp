@@ -1,12 +1,65 @@
 
+#include <stdexcept>
+#include "batch-kernels.h"
 #include "bspline.h"
 #include "gnuplot.h"
 
+// Checked before anything is copied into the fixed-size array, in release
+// builds too.
+Knots::Knots(const vector<double> &knots): cnt(0) {
+	if (knots.size() < 2 || knots.size() > (size_t) MAX_CNT)
+		throw invalid_argument("a B-spline needs from 2 to " + to_string(MAX_CNT) + " knots, got "
+				+ to_string(knots.size()));
+	cnt = knots.size();
+	copy(knots.begin(), knots.end(), values);
+}
+
 double Bspline::apply(double x, double y) const {
 	return constant * apply_1d(x_knots, x) * apply_1d(y_knots, y);
 }
 
-Cube Bspline::get_containing_cube(const vector<double>& _x_knots, const vector<double>& _y_knots) {
+void Bspline::apply_batch(const double* xs, const double* ys, double* out, int cnt) const {
+	double x_values[BATCH_SIZE], y_values[BATCH_SIZE];
+	for (int from = 0; from < cnt; from += BATCH_SIZE) {
+		int batch_cnt = min(BATCH_SIZE, cnt - from);
+		bspline_1d_batch(x_knots.data(), x_knots.get_order(), xs + from, x_values, batch_cnt);
+		bspline_1d_batch(y_knots.data(), y_knots.get_order(), ys + from, y_values, batch_cnt);
+		scaled_product_batch(constant, x_values, y_values, out + from, batch_cnt);
+	}
+}
+
+// Each 1D basis is evaluated once per grid line rather than once per point.
+void Bspline::apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const {
+	vector<double> x_values(x_cnt), y_values(y_cnt);
+	bspline_1d_batch(x_knots.data(), x_knots.get_order(), xs, x_values.data(), x_cnt);
+	bspline_1d_batch(y_knots.data(), y_knots.get_order(), ys, y_values.data(), y_cnt);
+	outer_product_grid(constant, x_values.data(), x_cnt, y_values.data(), y_cnt, out);
+}
+
+// Derivatives of the product of the 1D B-splines, each of which is
+// evaluated with its derivatives in a single recursion.
+void Bspline::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const {
+	double x_values[BATCH_SIZE], x_firsts[BATCH_SIZE], x_seconds[BATCH_SIZE];
+	double y_values[BATCH_SIZE], y_firsts[BATCH_SIZE], y_seconds[BATCH_SIZE];
+	for (int from = 0; from < cnt; from += BATCH_SIZE) {
+		int batch_cnt = min(BATCH_SIZE, cnt - from);
+		bspline_1d_derivatives_batch(x_knots.data(), x_knots.get_order(), xs + from,
+				x_values, x_firsts, x_seconds, batch_cnt);
+		bspline_1d_derivatives_batch(y_knots.data(), y_knots.get_order(), ys + from,
+				y_values, y_firsts, y_seconds, batch_cnt);
+		for (int i = 0; i < batch_cnt; i++) {
+			Derivatives& d = out[from + i];
+			d.value = constant * x_values[i] * y_values[i];
+			d.dx = constant * x_firsts[i] * y_values[i];
+			d.dy = constant * x_values[i] * y_firsts[i];
+			d.dxx = constant * x_seconds[i] * y_values[i];
+			d.dxy = constant * x_firsts[i] * y_firsts[i];
+			d.dyy = constant * x_values[i] * y_seconds[i];
+		}
+	}
+}
+
+Cube Bspline::get_containing_cube(const Knots& _x_knots, const Knots& _y_knots) {
 	return Cube(
 			_x_knots.front(), _x_knots.back(),
 			_y_knots.front(), _y_knots.back());
@@ -18,37 +71,45 @@ Rect Bspline::get_support_as_rect() const {
 			y_knots.front(), y_knots.back());
 }
 
-double Bspline::apply_1d(const vector<double>& knots, double point) {
-	int order = knots.size() - 2;
-
-	// 0..order o's, 0..order b's
-	double* values = new double[(order+1)*(order+1)];
-#define val(o,b) values[(o) * (order+1) + (b)]
-
-	for (int o = 0; o <= order; o++) {
-		for (int b = 0; b <= order-o; b++) {
-			if (o == 0) {
-				bool point_covered = knots[b] <= point && point < knots[b+1];
-				val(0, b) = point_covered ? 1.0 : 0.0;
-			} else {
-				double left_num  = point - knots[b];
-				double left_den  = knots[b+o] - knots[b];
-				double right_num = knots[b+o+1] - point;
-				double right_den = knots[b+o+1] - knots[b+1];
-
-				double left = 0.0, right = 0.0;
-				if (left_den != 0.0)
-					left = left_num  / left_den * val(o-1, b);
-				if (right_den != 0.0)
-					right = right_num / right_den * val(o-1, b+1);
-
-				val(o, b) = left + right;
-			}
+// Cox-de Boor recursion for a B-spline of the given order, which needs
+// order + 2 knots. Basis values of each order overwrite those of the lower
+// one in place, so that only order + 1 values live on the stack.
+template <int ORDER>
+static double apply_1d_of_order(const double* knots, double point) {
+	double values[ORDER + 1];
+	for (int b = 0; b <= ORDER; b++) {
+		bool point_covered = knots[b] <= point && point < knots[b+1];
+		values[b] = point_covered ? 1.0 : 0.0;
+	}
+
+	for (int o = 1; o <= ORDER; o++) {
+		for (int b = 0; b <= ORDER-o; b++) {
+			double left_num  = point - knots[b];
+			double left_den  = knots[b+o] - knots[b];
+			double right_num = knots[b+o+1] - point;
+			double right_den = knots[b+o+1] - knots[b+1];
+
+			double left = 0.0, right = 0.0;
+			if (left_den != 0.0)
+				left = left_num  / left_den * values[b];
+			if (right_den != 0.0)
+				right = right_num / right_den * values[b+1];
+
+			values[b] = left + right;
 		}
 	}
 
-	double result = val(order, 0);
-	delete values;
-	return result;
+	return values[0];
+}
+
+double Bspline::apply_1d(const Knots& knots, double point) {
+	switch (knots.get_order()) {
+		case 0: return apply_1d_of_order<0>(knots.data(), point);
+		case 1: return apply_1d_of_order<1>(knots.data(), point);
+		case 2: return apply_1d_of_order<2>(knots.data(), point);
+		case 3: return apply_1d_of_order<3>(knots.data(), point);
+		case 4: return apply_1d_of_order<4>(knots.data(), point);
+		default: throw invalid_argument("unsupported B-spline order " + to_string(knots.get_order()));
+	}
 }
 
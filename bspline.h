@@ -10,6 +10,40 @@ static vector<double> asc(vector<double> v) {
 	return v;
 }
 
+// Knots of a 1D B-spline, kept in place rather than on the heap.
+class Knots {
+public:
+	// Up to order 4 (of order = knot count - 2).
+	static const int MAX_CNT = 6;
+
+	// Throws invalid_argument unless there are from 2 to MAX_CNT knots.
+	Knots(const vector<double> &knots);
+
+	int get_order() const {
+		return cnt - 2;
+	}
+
+	double front() const {
+		return values[0];
+	}
+
+	double back() const {
+		return values[cnt - 1];
+	}
+
+	const double* data() const {
+		return values;
+	}
+
+	vector<double> to_vector() const {
+		return vector<double>(values, values + cnt);
+	}
+
+private:
+	double values[MAX_CNT];
+	int cnt;
+};
+
 class Bspline: public Function2D {
 public:
 
@@ -21,12 +55,18 @@ public:
 
 	double apply(double x, double y) const;
 
+	void apply_batch(const double* xs, const double* ys, double* out, int cnt) const;
+
+	void apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const;
+
+	void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
 	vector<double> get_x_knots() const {
-		return x_knots;
+		return x_knots.to_vector();
 	}
 
 	vector<double> get_y_knots() const {
-		return y_knots;
+		return y_knots.to_vector();
 	}
 
 	Rect get_support_as_rect() const;
@@ -37,11 +77,11 @@ public:
 
 private:
 
-	static Cube get_containing_cube(const vector<double>& _x_knots, const vector<double>& _y_knots);
+	static Cube get_containing_cube(const Knots& _x_knots, const Knots& _y_knots);
 
-	static double apply_1d(const vector<double>& knots, double point);
+	static double apply_1d(const Knots& knots, double point);
 
-	vector<double> x_knots, y_knots;
+	Knots x_knots, y_knots;
 
 	double constant;
 };
@@ -0,0 +1,72 @@
+#include <iostream>
+using namespace std;
+
+#include "gnuplot.h"
+#include "bspline.h"
+#include "linear-combination.h"
+#include "bspline-non-rect.h"
+
+// Not a multiple of any power of two, so that the samples round.
+const Rect AREA(-0.3, 8.3, -0.7, 8.1);
+const int SAMPLE_CNT = 64; // in each dimension
+
+// Prints at how many of the sample points apply_batch and apply_grid differ
+// from apply, returning whether they all agree.
+bool check(const string& name, const Function2D& f) {
+	vector<double> xs, ys, point_xs, point_ys;
+	sample_axes_2d(AREA, SAMPLE_CNT, &xs, &ys);
+	for (double x: xs)
+		for (double y: ys) {
+			point_xs.push_back(x);
+			point_ys.push_back(y);
+		}
+	int cnt = point_xs.size();
+	vector<double> batch(cnt), grid(cnt);
+	f.apply_batch(point_xs.data(), point_ys.data(), batch.data(), cnt);
+	f.apply_grid(xs.data(), SAMPLE_CNT, ys.data(), SAMPLE_CNT, grid.data());
+
+	int batch_diff_cnt = 0, grid_diff_cnt = 0;
+	for (int i = 0; i < cnt; i++) {
+		double value = f.apply(point_xs[i], point_ys[i]);
+		batch_diff_cnt += batch[i] != value;
+		grid_diff_cnt += grid[i] != value;
+	}
+	cout << name << ": " << batch_diff_cnt << " of " << cnt << " points differ in apply_batch, "
+		<< grid_diff_cnt << " in apply_grid" << endl;
+	return batch_diff_cnt == 0 && grid_diff_cnt == 0;
+}
+
+// Checks that the batch and grid evaluation of functions of each kind gives
+// exactly the values of apply, whatever instruction set the kernels use.
+int main() {
+	bool all_equal = true;
+
+	Bspline linear({ 0.5, 2.5, 3.5 }, { 1.5, 2, 7.5 }, 0.7);
+	Bspline quadratic({ 0, 1.5, 3, 5.5 }, { 0.5, 2, 2, 6 });
+	Bspline cubic({ 0.5, 1, 3, 4.5, 7.5 }, { 0, 1, 2.5, 4, 8 }, 1.3);
+	Bspline quartic({ 0, 1, 2.5, 3, 6, 8 }, { 0.5, 1.5, 3, 3, 5, 7.5 });
+	all_equal &= check("Bspline of order 1", linear);
+	all_equal &= check("Bspline of order 2", quadratic);
+	all_equal &= check("Bspline of order 3", cubic);
+	all_equal &= check("Bspline of order 4", quartic);
+
+	LinearFunction linear_function(0.3, -1.7, 2.9);
+	all_equal &= check("LinearFunction", linear_function);
+
+	LinearCombination combination({ &linear, &quadratic, &cubic, &linear_function }, { 0.1, -2.3, 3.7, 0.9 });
+	all_equal &= check("LinearCombination", combination);
+
+	ZeroOutside zero_outside(&combination, Rect(1.1, 5.3, 0.9, 6.2));
+	all_equal &= check("ZeroOutside", zero_outside);
+
+	Quotient quotient(quadratic, combination);
+	all_equal &= check("Quotient", quotient);
+
+	GnomonBspline gnomon(4, 4, -4, -4);
+	all_equal &= check("GnomonBspline", gnomon);
+
+	NurbsOverAdaptedGrid nurbs(3);
+	all_equal &= check("NurbsSum", NurbsSum(nurbs));
+
+	return all_equal ? 0 : 1;
+}
@@ -7,6 +7,9 @@
 
 typedef long Coord;
 
+// Maximal number of dimensions of a cube, fixed so that cubes need no heap.
+const int DIM_CNT = 2;
+
 enum {
 	X_DIM = 0,
 	Y_DIM = 1
@@ -0,0 +1,32 @@
+#include <algorithm>
+
+#include "csr-matrix.h"
+
+using namespace std;
+
+int CsrMatrix::find(int row, int column) const {
+	auto begin = columns.begin() + row_offsets[row];
+	auto end = columns.begin() + row_offsets[row + 1];
+	auto it = lower_bound(begin, end, column);
+	return it != end && *it == column ? it - columns.begin() : -1;
+}
+
+vector<double> CsrMatrix::get_row_sums() const {
+	vector<double> sums(row_cnt, 0.0);
+	for (int row = 0; row < row_cnt; row++)
+		for (int k = row_offsets[row]; k < row_offsets[row + 1]; k++)
+			sums[row] += values[k];
+	return sums;
+}
+
+void CsrMatrix::print(TextWriter &out) const {
+	out << row_cnt << " " << column_cnt << " " << get_nonzero_count() << '\n';
+	for (int row = 0; row < row_cnt; row++) {
+		out << row_offsets[row + 1] - row_offsets[row];
+		for (int k = row_offsets[row]; k < row_offsets[row + 1]; k++) {
+			out << " " << columns[k] + 1 << " ";
+			out.write_exact(values[k]);
+		}
+		out << '\n';
+	}
+}
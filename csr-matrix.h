@@ -0,0 +1,36 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_CSRMATRIX_H
+#define BSPLINE_SINGULARITIES_GALOIS_CSRMATRIX_H
+
+#include <vector>
+
+#include "text-writer.h"
+
+using namespace std;
+
+// A sparse matrix in the compressed sparse row format: nonzeros of the row i
+// are those at positions row_offsets[i] up to row_offsets[i+1], their columns
+// in ascending order.
+struct CsrMatrix {
+	int row_cnt = 0, column_cnt = 0;
+	vector<int> row_offsets = { 0 };
+	vector<int> columns;
+	vector<double> values;
+
+	int get_nonzero_count() const {
+		return row_offsets.back();
+	}
+
+	// Position of the nonzero at (row, column) within `values', or -1 if it is
+	// not a part of the sparsity pattern.
+	int find(int row, int column) const;
+
+	// Sums of the values of each row, each added up in the order of columns.
+	vector<double> get_row_sums() const;
+
+	// Prints the sizes and nonzeros count, then each row as the count of its
+	// nonzeros followed by their columns (counting from 1) and values, the
+	// latter exactly (with "%.17g").
+	void print(TextWriter &out) const;
+};
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_CSRMATRIX_H
@@ -1,26 +1,33 @@
 #include "cube.h"
 #include "coord.h"
+#include <algorithm>
+#include <cassert>
 #include <vector>
-#include <iostream>
 
 using namespace std;
 
 // A general hyper-cube for any number of dim_cnt.
 
-Cube::Cube() {}
+Cube::Cube(): Cube(DIM_CNT) {}
 
 Cube::Cube(int dims): dim_cnt(dims) {
-	bounds.resize(dims * 2);
-	neighbors.resize(dims * 2);
+	assert(dims <= DIM_CNT);
+	fill(bounds, bounds + 2 * DIM_CNT, 0);
+	fill(neighbors, neighbors + 2 * DIM_CNT, NO_NEIGHBOR);
 }
 
-Cube::Cube(Coord l, Coord r, Coord u, Coord d): dim_cnt(2) {
-	bounds = { l, r, u, d };
-	neighbors.resize(4);
+Cube::Cube(Coord l, Coord r, Coord u, Coord d): Cube(2) {
+	bounds[0] = l;
+	bounds[1] = r;
+	bounds[2] = u;
+	bounds[3] = d;
 }
 
 Cube::Cube(const Cube &cube, int n, int l, int id, int flag) :
-	dim_cnt(cube.dim_cnt), bounds(cube.bounds), neighbors(cube.neighbors), level(l), num(n), id_within_level(id) {
+	Cube(cube) {
+		level = l;
+		num = n;
+		id_within_level = id;
 	}
 
 
@@ -71,22 +78,18 @@ int Cube::get_level() const {
 	return level;
 }
 
-Cube* Cube::get_neighbor(int bound_no) const {
+int Cube::get_neighbor(int bound_no) const {
 	return neighbors[bound_no];
 }
 
 int Cube::get_neighbor_count() const {
 	int cnt = 0;
 	for (int bound_no = 0; bound_no < 2 * dim_cnt; bound_no++)
-		if (neighbors[bound_no] != nullptr)
+		if (neighbors[bound_no] != NO_NEIGHBOR)
 			cnt++;
 	return cnt;
 }
 
-vector<int> Cube::get_bsplines() const {
-	return bsplines;
-}
-
 
 /*** SETTERS ***/
 
@@ -95,8 +98,8 @@ void Cube::set_bounds(int dim, Coord from, Coord to) {
 	bounds[dim * 2 + 1] = to;
 }
 
-void Cube::set_neighbor(int bound_no, Cube* cube) {
-	neighbors[bound_no] = cube;
+void Cube::set_neighbor(int bound_no, int neighbor) {
+	neighbors[bound_no] = neighbor;
 }
 
 
@@ -157,28 +160,19 @@ Cube Cube::get_cube_enclosing_both(const Cube& other) const {
 
 /*** PRINTING ***/
 
-void Cube::print_full() const {
-	print_bounds();
-	print_id();
-	cout << endl;
+void Cube::print_full(TextWriter &out) const {
+	print_bounds(out);
+	print_id(out);
+	out << '\n';
 }
 
-void Cube::print_id() const {
-	cout << get_num()+1 << " " << get_level() << " ";
+void Cube::print_id(TextWriter &out) const {
+	out << get_num()+1 << " " << get_level() << " ";
 }
 
-void Cube::print_bounds() const {
+void Cube::print_bounds(TextWriter &out) const {
 	for (int i = 0; i < dim_cnt * 2; i++)
-		cout << bounds[i] << " ";
-}
-
-void Cube::print_level_id_and_bsplines(int e_num) const {
-	cout << get_level() << " ";
-	cout << e_num << " ";
-	cout << bsplines.size();
-	for (int bspline: bsplines)
-		cout << " " << bspline + 1;
-	cout << endl;
+		out << bounds[i] << " ";
 }
 
 
@@ -240,44 +234,10 @@ void Cube::pump_or_squeeze(int shift) {
 	}
 }
 
-void Cube::back_up_bounds() {
-	backed_up_bounds = bounds;
-}
-
-void Cube::restore_bounds() {
-	bounds = backed_up_bounds;
-}
-
 
 /*** B-SPLINES ***/
 
-vector<Coord> Cube::compute_bspline_support_2D() {
-	vector<Coord> support_bounds;
-	support_bounds.resize(dim_cnt * 2);
-	for(int i = 0; i < dim_cnt * 2; ++i) {
-		if (neighbors[i]) {
-			support_bounds[i] = neighbors[i]->get_bound(i);
-		} else {
-			support_bounds[i] = bounds[i];
-		}
-	}
-	return support_bounds;
-};
-
-bool Cube::is_bspline_duplicated(int bspline_num) {
-	for (int curr_bspline: bsplines) {
-		if (curr_bspline == bspline_num) {
-			return true;
-		}
-	}
-	return false;
-}
-
-void Cube::add_bspline(int bspline_num) {
-	bsplines.push_back(bspline_num);
-}
-
-vector<double> Cube::get_dim_knots(const Cube &support_cube, int dim) {
+vector<double> Cube::get_dim_knots(const Cube &support_cube, int dim) const {
 	int from = 2 * dim;
 	int to = 2 * dim + 1;
 	vector<double> knots;
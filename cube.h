@@ -6,10 +6,14 @@
 #define BSPLINE_SINGULARITIES_GALOIS_CUBE_H
 
 #include "coord.h"
+#include "text-writer.h"
 #include "vector"
 
 using namespace std;
 
+// Neighbor index of a cube which has no neighbor on the given side.
+const int NO_NEIGHBOR = -1;
+
 class Cube {
 
 public:
@@ -50,15 +54,13 @@ public:
 
 	int get_dim_cnt() const;
 
-	Cube *get_neighbor(int bound_no) const;
+	int get_neighbor(int bound_no) const;
 
 	int get_neighbor_count() const;
 
-	vector<int> get_bsplines() const;
-
 	void set_bounds(int dim, Coord from, Coord to);
 
-	void set_neighbor(int bound_no, Cube *cube);
+	void set_neighbor(int bound_no, int neighbor);
 
 	bool contained_in_box(const Cube &box) const;
 
@@ -74,13 +76,11 @@ public:
 
 	Cube get_cube_enclosing_both(const Cube &other) const;
 
-	void print_full() const;
+	void print_full(TextWriter &out) const;
 
-	void print_id() const;
+	void print_id(TextWriter &out) const;
 
-	void print_bounds() const;
-
-	void print_level_id_and_bsplines(int e_num) const;
+	void print_bounds(TextWriter &out) const;
 
 	void split(int dim, Coord coord, Cube *first, Cube *second) const;
 
@@ -96,30 +96,17 @@ public:
 
 	void pump_or_squeeze(int shift);
 
-	void back_up_bounds();
-
-	void restore_bounds();
-
-	vector<Coord> compute_bspline_support_2D();
-
-	void add_bspline(int bspline_num);
-
-	bool is_bspline_duplicated(int bspline_num);
-
-	vector<double> get_dim_knots(const Cube &support_cube, int dim);
+	vector<double> get_dim_knots(const Cube &support_cube, int dim) const;
 
 private:
 
 	// Number of dimensions.
 	int dim_cnt;
 	// Boundaries of the cube.
-	vector<Coord> bounds;
-	// bounds' backup, for the sake of restoring after tweaks.
-	vector<Coord> backed_up_bounds;
-	// Neighbors of the cube (must be separately computed).
-	vector<Cube*> neighbors;
-	// B-splines covering the cube (must be separately computed).
-	vector<int> bsplines;
+	Coord bounds[2 * DIM_CNT];
+	// Indices of the neighbors of the cube within its domain's elements
+	// (must be separately computed).
+	int neighbors[2 * DIM_CNT];
 	// Level, enumerator and id within the level.
 	int level, num, id_within_level;
 };
@@ -3,6 +3,7 @@
 //#include "vector"
 #include "node.h"
 #include "domain.h"
+#include "parallel.h"
 #include <chrono>
 #include <thread>
 
@@ -32,81 +33,59 @@ bool Domain::is_vertical_side_element(const Cube &cube, Coord middle) const {
 	return (cube.right() == middle) || (cube.left() == middle);
 }
 
-bool Domain::overlaps_with_any_other(const Cube &that) const {
-	for (const auto& other: elements)
-		if (&that != &other && that.overlaps_with(other))
-			return true;
-	return false;
-}
-
 /*** SPLIT ELEMENTS ***/
 
+// Elements are refined in place: a split element is only marked as dropped
+// and its children are appended to `elements'. The children take the place
+// of their parent once the elements are compacted.
+
 void Domain::split_eight_side_elements_within_box_2D(Cube cube) {
 	Coord mid = cube.get_middle(X_DIM);
-	vector<Cube> old_elements;
-	elements.swap(old_elements);
-	for (const auto& e: old_elements) {
-		if (e.non_empty() && e.contained_in_box(cube) && !is_middle_element(e, mid)) {
+	int old_cnt = elements.size();
+	for (int e_no = 0; e_no < old_cnt; e_no++) {
+		const Cube& e = elements[e_no];
+		if (!refinements[e_no].dropped && e.non_empty() && e.contained_in_box(cube) && !is_middle_element(e, mid)) {
+			Cube halves[2];
 			if (is_horizontal_side_element(e, mid)) {
-				Cube el1, el2;
-				e.split_halves(Y_DIM, &el1, &el2);
-				add_element(el1);
-				add_element(el2);
+				e.split_halves(Y_DIM, &halves[0], &halves[1]);
+				replace_element(e_no, halves, 2);
 			} else if(is_vertical_side_element(e, mid)) {
-				Cube el1, el2;
-				e.split_halves(X_DIM, &el1, &el2);
-				add_element(el1);
-				add_element(el2);
-			} else {
-				add_element(e);
+				e.split_halves(X_DIM, &halves[0], &halves[1]);
+				replace_element(e_no, halves, 2);
 			}
-		} else {
-			add_element(e);
 		}
 	}
 }
 
 // Splits each element within the given box into 4 smaller ones.
 void Domain::split_elements_within_box_into_4_2D(const Cube &box) {
-	vector<Cube> old_elements;
-	elements.swap(old_elements);
-	for (const auto& e: old_elements) {
-		if (e.non_empty() && e.contained_in_box(box)) {
+	int old_cnt = elements.size();
+	for (int e_no = 0; e_no < old_cnt; e_no++) {
+		const Cube& e = elements[e_no];
+		if (!refinements[e_no].dropped && e.non_empty() && e.contained_in_box(box)) {
 			Cube el, er;
 			e.split_halves(X_DIM, &el, &er);
-			Cube el1, el2, er1, er2;
-			el.split_halves(Y_DIM, &el1, &el2);
-			er.split_halves(Y_DIM, &er1, &er2);
-			add_element(el1);
-			add_element(el2);
-			add_element(er1);
-			add_element(er2);
-		} else {
-			add_element(e);
+			Cube quarters[4];
+			el.split_halves(Y_DIM, &quarters[0], &quarters[1]);
+			er.split_halves(Y_DIM, &quarters[2], &quarters[3]);
+			replace_element(e_no, quarters, 4);
 		}
 	}
 }
 
 // Splits each element within the given box into 6 smaller ones.
 void Domain::split_elements_within_box_into_6_2D(const Cube &box) {
-	vector<Cube> old_elements;
-	elements.swap(old_elements);
-	for (const auto &e: old_elements) {
-		if (e.non_empty() && e.contained_in_box(box)) {
+	int old_cnt = elements.size();
+	for (int e_no = 0; e_no < old_cnt; e_no++) {
+		const Cube& e = elements[e_no];
+		if (!refinements[e_no].dropped && e.non_empty() && e.contained_in_box(box)) {
 			Cube e1, e2, e3;
 			e.split_thirds(X_DIM, &e1, &e2, &e3);
-			Cube e11, e12, e21, e22, e31, e32;
-			e1.split_halves(Y_DIM, &e11, &e12);
-			e2.split_halves(Y_DIM, &e21, &e22);
-			e3.split_halves(Y_DIM, &e31, &e32);
-			add_element(e11);
-			add_element(e12);
-			add_element(e21);
-			add_element(e22);
-			add_element(e31);
-			add_element(e32);
-		} else {
-			add_element(e);
+			Cube sixths[6];
+			e1.split_halves(Y_DIM, &sixths[0], &sixths[1]);
+			e2.split_halves(Y_DIM, &sixths[2], &sixths[3]);
+			e3.split_halves(Y_DIM, &sixths[4], &sixths[5]);
+			replace_element(e_no, sixths, 6);
 		}
 	}
 }
@@ -123,15 +102,44 @@ void Domain::split_all_elements_into_6_2D() {
 
 
 void Domain::remove_all_elements_not_contained_in(const Cube &box) {
-	vector<Cube> old_elements;
-	elements.swap(old_elements);
-	for (const auto &e: old_elements) {
-		if (e.contained_in_box(box)) {
-			add_element(e);
+	for (unsigned e_no = 0; e_no < elements.size(); e_no++) {
+		if (!refinements[e_no].dropped && !elements[e_no].contained_in_box(box)) {
+			replace_element(e_no, nullptr, 0);
 		}
 	}
 }
 
+// Drops the given element in favor of `child_cnt' children.
+void Domain::replace_element(int e_no, const Cube *children, int child_cnt) {
+	refinements[e_no].dropped = true;
+	refinements[e_no].first_child = elements.size();
+	refinements[e_no].child_cnt = child_cnt;
+	for (int i = 0; i < child_cnt; i++) {
+		add_element(children[i]);
+		refinements.back().is_child = true;
+	}
+}
+
+// Rebuilds `elements' out of the elements which are not dropped, each child
+// placed where its parent was.
+void Domain::compact_elements() {
+	vector<Cube> compacted;
+	for (unsigned e_no = 0; e_no < elements.size(); e_no++)
+		if (!refinements[e_no].is_child)
+			append_compacted(e_no, &compacted);
+	elements.swap(compacted);
+	refinements.assign(elements.size(), ElementRefinement());
+}
+
+void Domain::append_compacted(int e_no, vector<Cube> *compacted) const {
+	const ElementRefinement& refinement = refinements[e_no];
+	if (!refinement.dropped) {
+		compacted->push_back(elements[e_no]);
+		return;
+	}
+	for (int i = 0; i < refinement.child_cnt; i++)
+		append_compacted(refinement.first_child + i, compacted);
+}
 
 
 /*** ADD ELEMENTS ***/
@@ -154,10 +162,10 @@ void Domain::add_edge_2D(int dim, const Cube &box, Coord coord, int count, bool
 				Coord mid = (element_from + element_to) / 2;
 				e1.set_bounds(dim, element_from, mid);
 				e1.set_bounds(dim ^ 1, coord, coord);  // the other dimension
-				elements.push_back(e1);
+				add_element(e1);
 				e2.set_bounds(dim, mid, element_to);
 				e2.set_bounds(dim ^ 1, coord, coord);  // the other dimension
-				elements.push_back(e2);
+				add_element(e2);
 				if(dim == X_DIM) {
 					add_vertex_2D(mid, coord);
 				} else {
@@ -167,13 +175,13 @@ void Domain::add_edge_2D(int dim, const Cube &box, Coord coord, int count, bool
 				Cube e(2);
 				e.set_bounds(dim, element_from, element_to);
 				e.set_bounds(dim ^ 1, coord, coord);  // the other dimension
-				elements.push_back(e);
+				add_element(e);
 			}
 		} else {
 			Cube e(2);
 			e.set_bounds(dim, element_from, element_to);
 			e.set_bounds(dim ^ 1, coord, coord);  // the other dimension
-			elements.push_back(e);
+			add_element(e);
 		}
 	}
 }
@@ -191,20 +199,21 @@ void Domain::add_corner_vertices_2D(const Cube &box) {
 /*** PRINT ELEMENTS ***/
 
 void Domain::print_elements_within_box(const Cube &box) const {
-	cout << elements.size() << endl;
+	*out << elements.size() << '\n';
 	for (const auto& e: elements) {
 		if (e.contained_in_box(box)) {
-			e.print_bounds();
-			cout << endl;
+			e.print_bounds(*out);
+			*out << '\n';
 		}
 	}
 }
 
 void Domain::print_elements_level_and_id_within_box(const Node *node) const {
-	for (const auto& e: elements) {
-		if (e.non_empty() && e.contained_in_box(node->get_cube())) {
-			cout << e.get_level() << " " << e.get_id_within_level() << " ";
-		}
+	vector<int> found;
+	element_tree.find_contained(node->get_cube(), &found);
+	for (int e_no: found) {
+		const Cube& e = elements[e_no];
+		*out << e.get_level() << " " << e.get_id_within_level() << " ";
 	}
 }
 
@@ -213,11 +222,11 @@ void Domain::print_all_elements() const {
 }
 
 void Domain::println_non_empty_elements_count() const {
-	cout << count_non_empty_elements() << endl;
+	*out << count_non_empty_elements() << '\n';
 }
 
 void Domain::print_tree_nodes_count() const {
-	cout << get_tree_nodes().size() << endl;
+	*out << get_tree_node_count() << '\n';
 }
 
 void Domain::print_galois_output() const {
@@ -226,13 +235,46 @@ void Domain::print_galois_output() const {
 	print_elements_per_tree_nodes();
 }
 
-void Domain::print_line(Coord x1, Coord y1, Coord x2, Coord y2) {
-	cout << x1 << " " << y1 << " " << x2 << " " << y2 << endl;
+void Domain::get_galois_mesh(GaloisMesh *mesh) const {
+	*mesh = GaloisMesh();
+	for (const auto& e: elements) {
+		mesh->bspline_ids.push_back(e.get_num() + 1);
+		mesh->bspline_flags.push_back(1);
+	}
+
+	for (const auto& e: elements) {
+		if (!e.non_empty())
+			continue;
+		mesh->element_levels.push_back(e.get_level());
+		mesh->element_ids.push_back(e.get_id_within_level());
+		for (int bspline: get_element_bsplines(e.get_num()))
+			mesh->element_bsplines.push_back(bspline + 1);
+		mesh->element_bspline_offsets.push_back(mesh->element_bsplines.size());
+	}
+
+	vector<int> found;
+	for (const Node* node: get_tree_nodes()) {
+		mesh->node_ids.push_back(node->get_num() + 1);
+		found.clear();
+		element_tree.find_contained(node->get_cube(), &found);
+		for (int e_no: found) {
+			mesh->node_element_levels.push_back(elements[e_no].get_level());
+			mesh->node_element_ids.push_back(elements[e_no].get_id_within_level());
+		}
+		mesh->node_element_offsets.push_back(mesh->node_element_levels.size());
+		for (const Node* n: node->get_children())
+			mesh->node_children.push_back(n->get_num() + 1);
+		mesh->node_child_offsets.push_back(mesh->node_children.size());
+	}
+}
+
+void Domain::print_line(Coord x1, Coord y1, Coord x2, Coord y2) const {
+	*out << x1 << " " << y1 << " " << x2 << " " << y2 << '\n';
 }
 
-void Domain::print_tabs(int cnt) {
+void Domain::print_tabs(int cnt) const {
 	for (int i = 0; i < cnt; i++)
-		cout << "  ";
+		*out << "  ";
 }
 
 
@@ -264,41 +306,50 @@ void Domain::print_all_neighbors() const {
 	int total_cnt = 0;
 	for (const Cube& e: elements)
 		total_cnt += e.get_neighbor_count();
-	cout << total_cnt << endl;
+	*out << total_cnt << '\n';
 	for (const Cube& that: elements) {
 		for (int bound_no = 0; bound_no < that.get_dim_cnt() * 2; bound_no++) {
-			Cube* other = that.get_neighbor(bound_no);
-			if (other != nullptr) {
+			int other_no = that.get_neighbor(bound_no);
+			if (other_no != NO_NEIGHBOR) {
+				const Cube& other = elements[other_no];
 				print_line(
 						that.get_middle(X_DIM), that.get_middle(Y_DIM),
-						other->get_middle(X_DIM), other->get_middle(Y_DIM)
+						other.get_middle(X_DIM), other.get_middle(Y_DIM)
 						);
 			}
 		}
 	}
 }
 
+// Only the elements whose opposite bound touches the given one are checked,
+// as looked up in the bound index (built by compute_all_neighbors). When more
+// than one matches, the last one in the elements' order wins.
 void Domain::compute_neighbors(Cube &that, Coord size) {
 	// Check regular neighbors.
-	for (auto& other: elements)
-		for (int bound_no = 0; bound_no < that.get_dim_cnt() * 2; bound_no++)
-			if (cubes_are_adjacent(that, other, bound_no, false))
-				that.set_neighbor(bound_no, &other);
+	for (int bound_no = 0; bound_no < that.get_dim_cnt() * 2; bound_no++)
+		for (int other_no: bound_index.get_elements_at(bound_no ^ 1, that.get_bound(bound_no)))
+			if (cubes_are_adjacent(that, elements[other_no], bound_no, false))
+				that.set_neighbor(bound_no, other_no);
 	// Check extra neigbors if regular are not found.
 	for (int bound_no = 0; bound_no < that.get_dim_cnt() * 2; bound_no++) {
-		if(that.get_neighbor(bound_no) == nullptr &&
+		if(that.get_neighbor(bound_no) == NO_NEIGHBOR &&
 				that.get_bound(bound_no) != 0 && that.get_bound(bound_no) != size) {
-			for (auto& other: elements) {
-				if (cubes_are_adjacent(that, other, bound_no, true))
-					that.set_neighbor(bound_no, &other);
+			for (int other_no: bound_index.get_elements_at(bound_no ^ 1, that.get_bound(bound_no))) {
+				if (cubes_are_adjacent(that, elements[other_no], bound_no, true))
+					that.set_neighbor(bound_no, other_no);
 			}
 		}
 	}
 }
 
+// Each element only gets its own neighbors set, so the elements are split
+// between threads.
 void Domain::compute_all_neighbors(Coord size) {
-	for (auto& e: elements)
-		compute_neighbors(e, size);
+	bound_index.build(elements);
+	parallel_for(elements.size(), thread_cnt, [this, size](int from, int to) {
+		for (int e_no = from; e_no < to; e_no++)
+			compute_neighbors(elements[e_no], size);
+	});
 }
 
 
@@ -312,30 +363,58 @@ vector<Cube> Domain::get_cut_off_boxes() const {
 	return cut_off_boxes;
 }
 
+// Counts non-empty elements through the element tree, so it is only valid
+// after enumerate_all_elements and with untweaked bounds.
 int Domain::count_elements_within_box(const Cube &cube) const {
-	int count = 0;
-	for (const auto& e: elements)
-		if (e.non_empty() && e.contained_in_box(cube))
-			count++;
-	return count;
+	return element_tree.count_contained(cube);
 }
 
 Node *Domain::add_tree_node(Cube cube, Node *parent) {
 	Node* node = new Node(cube, tree_node_id++);
 	if (parent) {
 		parent->add_child(node);
+	} else {
+		tree_root = node;
 	}
-	tree_nodes.push_back(node);
+	if (tree_output == STORE_TREE)
+		tree_nodes.push_back(node);
 	return node;
 }
 
+// Unless the tree is stored, nothing refers to the children of a finished
+// node anymore, so only the nodes along the path being built stay allocated.
+void Domain::finish_tree_node(Node *node) {
+	if (tree_output == STORE_TREE)
+		return;
+	if (tree_output == STREAM_TREE)
+		print_tree_node(node);
+	for (const Node* n: node->get_children())
+		delete n;
+	if (node == tree_root) {
+		delete node;
+		tree_root = nullptr;
+	}
+}
+
+void Domain::set_tree_output(TreeOutput output) {
+	tree_output = output;
+	tree_node_id = 0;
+	tree_root = nullptr;
+	cut_off_boxes.clear();
+}
+
+int Domain::get_tree_node_count() const {
+	return tree_node_id;
+}
+
 void Domain::tree_process_cut_off_box(int dim, Node *node, bool toggle_dim) {
 	int elements_cnt = count_elements_within_box(node->get_cube());
 	//cout << "tree process cut off box " << elements_cnt << endl;
-	if (elements_cnt == 1) // leaf
+	if (elements_cnt == 1) { // leaf
+		finish_tree_node(node);
 		return;
 
-	else if (elements_cnt > 1 && elements_cnt % 2 == 0) { //even num, we split into halves
+	} else if (elements_cnt > 1 && elements_cnt % 2 == 0) { //even num, we split into halves
 		//cout << "even" << endl;
 		Cube cut_off_cube = node->get_cube();
 		Cube first_half, second_half;
@@ -369,6 +448,7 @@ void Domain::tree_process_cut_off_box(int dim, Node *node, bool toggle_dim) {
 		tree_process_cut_off_box(dim, first_half_node, toggle_dim);
 		tree_process_cut_off_box(dim, second_half_node, toggle_dim);
 	}
+	finish_tree_node(node);
 }
 
 const vector<Node *>& Domain::get_tree_nodes() const {
@@ -381,16 +461,20 @@ void Domain::print_elements_per_tree_nodes() const {
 		//cout << "   tree node\n   ";
 		//node->get_cube().print_bounds();
 		//cout << endl;
-		node->print_num();
-		print_elements_count_within_node(node);
-		print_elements_level_and_id_within_box(node);
-		print_node_children(node);
+		print_tree_node(node);
 	}
 
 	// compute the supports here
 	// print_tree_postorder(tree_nodes[0], new vector<bool>(bsplines.size(), false));
 }
 
+void Domain::print_tree_node(const Node *node) const {
+	node->print_num(*out);
+	print_elements_count_within_node(node);
+	print_elements_level_and_id_within_box(node);
+	print_node_children(node);
+}
+
 void Domain::print_tree_postorder(const Node* node, vector<bool>* bspline_printed) const {
 	for (const Node* n: node->get_children())
 		print_tree_postorder(n, bspline_printed);
@@ -401,60 +485,81 @@ void Domain::print_tree_postorder(const Node* node, vector<bool>* bspline_printe
 	// It is enough just to lookup get_cube of the node!
 	for (unsigned i = 0; i < bsplines.size(); i++) {
 		if (!(*bspline_printed)[i] && bsplines[i].get_support().contained_in_box(node->get_cube())) {
-			cout << i << endl;
+			*out << i << '\n';
 			(*bspline_printed)[i] = true;
 		}
 	}
 }
 
 void Domain::print_tree_size() const {
-	cout << get_cut_off_boxes().size() << endl;
+	*out << get_cut_off_boxes().size() << '\n';
 }
 
 void Domain::print_tree_for_draw() const {
 	print_tree_size();
 	for (const Cube& box: get_cut_off_boxes()) {
-		box.print_full();
+		box.print_full(*out);
 	}
 }
 
 void Domain::print_node_children(const Node *node) const {
 	for (const Node* n: node->get_children()) {
-		cout << n->get_num() + 1 << " ";
+		*out << n->get_num() + 1 << " ";
 	}
-	cout << endl;
+	*out << '\n';
 }
 
 void Domain::print_elements_count_within_node(const Node *node) const {
-	cout << count_elements_within_box(node->get_cube()) << " ";
+	*out << count_elements_within_box(node->get_cube()) << " ";
 }
 
 
 /*** BOUNDARY TWEAKING ***/
 
 void Domain::tweak_bounds() {
-	for (auto& e: elements)
-		e.back_up_bounds();
-	original_box.back_up_bounds();
-
-	// Scale up all elements.
-	for (auto& e: elements)
-		e.scale_up(8);
+	// Back up, scale up all elements, then squeeze non-empty dims and pump up
+	// empty dims.
+	backed_up_bounds.resize(elements.size() * 2 * DIM_CNT);
+	parallel_for(elements.size(), thread_cnt, [this](int from, int to) {
+		for (int e_no = from; e_no < to; e_no++) {
+			Cube& e = elements[e_no];
+			for (int bound_no = 0; bound_no < 2 * e.get_dim_cnt(); bound_no++)
+				backed_up_bounds[e_no * 2 * DIM_CNT + bound_no] = e.get_bound(bound_no);
+			e.scale_up(8);
+			e.pump_or_squeeze(2);
+		}
+	});
+	backed_up_original_box = original_box;
 	original_box.scale_up(8);
 
-	// Squeeze non-empty dims, pump up empty dims.
-	for (auto& e: elements)
-		e.pump_or_squeeze(2);
+	// Find the elements each element might run into while being pumped back
+	// (each bound moves by at most 2). It only reads the squeezed bounds, so
+	// it is done in parallel, leaving the order-dependent pumping below
+	// to check just these candidates.
+	ElementTree overlap_tree;
+	overlap_tree.build(elements, false);
+	vector<vector<int>> candidates(elements.size());
+	parallel_for(elements.size(), thread_cnt, [this, &overlap_tree, &candidates](int from, int to) {
+		for (int e_no = from; e_no < to; e_no++) {
+			Cube pumped = elements[e_no];
+			pumped.spread(2);
+			overlap_tree.find_overlapping(pumped, 2, &candidates[e_no]);
+		}
+	});
 
 	// Try pump back non-empty dims (only if they won't overlap with now pumped-up empty dims).
-	for (auto& e: elements) {
+	for (unsigned e_no = 0; e_no < elements.size(); e_no++) {
+		Cube& e = elements[e_no];
 		for (int bound_no = 0; bound_no < 2 * e.get_dim_cnt(); bound_no++) {
 			if (e.get_size(bound_no / 2) == 2)
 				continue;  // skip empty dims
 			e.spread(bound_no, 2);
-			if (overlaps_with_any_other(e)) {
-				// Roll back the pumping if it interferes with any other element.
-				e.spread(bound_no, -2);
+			for (int other_no: candidates[e_no]) {
+				if (other_no != (int) e_no && e.overlaps_with(elements[other_no])) {
+					// Roll back the pumping if it interferes with any other element.
+					e.spread(bound_no, -2);
+					break;
+				}
 			}
 		}
 	}
@@ -462,59 +567,122 @@ void Domain::tweak_bounds() {
 }
 
 void Domain::untweak_bounds() {
-	for (auto& e: elements)
-		e.restore_bounds();
-	original_box.restore_bounds();
+	parallel_for(elements.size(), thread_cnt, [this](int from, int to) {
+		for (int e_no = from; e_no < to; e_no++) {
+			Cube& e = elements[e_no];
+			const Coord* backed_up = &backed_up_bounds[e_no * 2 * DIM_CNT];
+			for (int dim_no = 0; dim_no < e.get_dim_cnt(); dim_no++)
+				e.set_bounds(dim_no, backed_up[2 * dim_no], backed_up[2 * dim_no + 1]);
+		}
+	});
+	original_box = backed_up_original_box;
 }
 
 
 /*** B-SPLINES ***/
 
+// Supports of B-splines centered at different elements are independent, so
+// they are computed by threads into separate buffers, merged afterwards in
+// the order of elements.
 void Domain::compute_bsplines_supports(MeshType type, int order) {
-	for (auto& e: elements)
-		compute_bspline_support(type, order, e, e.get_num());
+	vector<BsplineSupport> supports(elements.size());
+	parallel_for(elements.size(), thread_cnt, [this, type, order, &supports](int from, int to) {
+		vector<int> last_bspline_added(elements.size(), -1);
+		for (int e_no = from; e_no < to; e_no++) {
+			const Cube& e = elements[e_no];
+			compute_bspline_support(type, order, e, e.get_num(), &last_bspline_added, &supports[e_no]);
+		}
+	});
+
+	for (const auto& support: supports)
+		bsplines.push_back(support.choice);
+	pack_element_bsplines(supports);
 }
 
-// Computes support for B-spline centered at the element `e'.
-void Domain::compute_bspline_support(MeshType type, int order, Cube &e, int original_bspline_num) {
-	vector<Coord> support_bounds = e.compute_bspline_support_2D();
+// Support bounds of the B-spline centered at the element `e', reaching as far
+// as its neighbors do.
+vector<Coord> Domain::compute_bspline_support_2D(const Cube &e) const {
+	vector<Coord> support_bounds;
+	support_bounds.resize(e.get_dim_cnt() * 2);
+	for(int i = 0; i < e.get_dim_cnt() * 2; ++i) {
+		if (e.get_neighbor(i) != NO_NEIGHBOR) {
+			support_bounds[i] = elements[e.get_neighbor(i)].get_bound(i);
+		} else {
+			support_bounds[i] = e.get_bound(i);
+		}
+	}
+	return support_bounds;
+}
+
+// Computes support for B-spline centered at the element `e'. For order > 2,
+// the support also spans the supports of order - 1 centered at each of the
+// elements found, and so on down to order 2. They are expanded breadth-first:
+// an element is expanded only once, when first found, which is also when it
+// has the highest order left. Elements found are marked with the B-spline in
+// `last_bspline_added'.
+void Domain::compute_bspline_support(MeshType type, int order, const Cube &e, int original_bspline_num,
+		vector<int> *last_bspline_added, BsplineSupport *support) const {
+	vector<Coord> support_bounds = compute_bspline_support_2D(e);
 	Cube support_cube(support_bounds[0], support_bounds[1], support_bounds[2], support_bounds[3]);
 
 	BsplineChoice choice;
 
-	for (auto &support_candidate: elements) {
-		if (support_candidate.non_empty() && support_candidate.contained_in_box(support_cube)) {
-			if (type == EDGED_4 && e.is_point_2D()) {
-				Coord min_el_size = e.get_neighbor(0)->get_size(0) / 2;
-				if (min_el_size > 1 && support_candidate.get_size(0) < min_el_size) {
-					// We just detected a gnomon-shaped B-spline!
-
-					/*cerr << "e.x = " << e.get_from(X_DIM) << ", e.y = " << e.get_from(Y_DIM)
-						<< ", min_el_size = " << min_el_size
-						<< ", support_candidate.get_size(X_DIM) = " << support_candidate.get_size(X_DIM) << endl;*/
-					
-					Coord x_mid = e.left();  // can be right() as well, nvm
-					// -1 or +1, depending on where the rejected candidate element lies
-					int shift_x_sign = sign(support_candidate.left() - e.left());
-					// The actual shift needed to define a GnomonBspline
-					Coord shift_x = shift_x_sign * min_el_size;
-
-					Coord y_mid = e.down();
-					int shift_y_sign = sign(support_candidate.down() - e.down());
-					Coord shift_y = shift_y_sign * min_el_size;
-
-					if (choice.gnomon == nullptr)
-						choice.gnomon = new GnomonBspline(x_mid, y_mid, shift_x, shift_y);
-					continue;
-				}
-			}
-			if (!support_candidate.is_bspline_duplicated(original_bspline_num)) {
-				support_candidate.add_bspline(original_bspline_num);
+	// Elements to expand with the next order.
+	vector<int> to_expand;
+
+	vector<int> candidates;
+	element_tree.find_contained(support_cube, &candidates);
+	for (int candidate_no: candidates) {
+		const Cube &support_candidate = elements[candidate_no];
+		if (type == EDGED_4 && e.is_point_2D()) {
+			Coord min_el_size = elements[e.get_neighbor(0)].get_size(0) / 2;
+			if (min_el_size > 1 && support_candidate.get_size(0) < min_el_size) {
+				// We just detected a gnomon-shaped B-spline!
+
+				/*cerr << "e.x = " << e.get_from(X_DIM) << ", e.y = " << e.get_from(Y_DIM)
+					<< ", min_el_size = " << min_el_size
+					<< ", support_candidate.get_size(X_DIM) = " << support_candidate.get_size(X_DIM) << endl;*/
+				
+				Coord x_mid = e.left();  // can be right() as well, nvm
+				// -1 or +1, depending on where the rejected candidate element lies
+				int shift_x_sign = sign(support_candidate.left() - e.left());
+				// The actual shift needed to define a GnomonBspline
+				Coord shift_x = shift_x_sign * min_el_size;
+
+				Coord y_mid = e.down();
+				int shift_y_sign = sign(support_candidate.down() - e.down());
+				Coord shift_y = shift_y_sign * min_el_size;
+
+				if (choice.gnomon == nullptr)
+					choice.gnomon = new GnomonBspline(x_mid, y_mid, shift_x, shift_y);
+				continue;
 			}
-			if (order > 2) {
-				compute_bspline_support(type, order - 1, support_candidate, original_bspline_num);
+		}
+		if ((*last_bspline_added)[candidate_no] != original_bspline_num) {
+			(*last_bspline_added)[candidate_no] = original_bspline_num;
+			support->elements.push_back(candidate_no);
+			if (order > 2)
+				to_expand.push_back(candidate_no);
+		}
+	}
+
+	vector<int> to_expand_next;
+	for (int expanded_order = order - 1; !to_expand.empty(); expanded_order--) {
+		for (int expanded_no: to_expand) {
+			vector<Coord> expanded_bounds = compute_bspline_support_2D(elements[expanded_no]);
+			Cube expanded_cube(expanded_bounds[0], expanded_bounds[1], expanded_bounds[2], expanded_bounds[3]);
+			element_tree.find_contained(expanded_cube, &candidates);
+			for (int candidate_no: candidates) {
+				if ((*last_bspline_added)[candidate_no] != original_bspline_num) {
+					(*last_bspline_added)[candidate_no] = original_bspline_num;
+					support->elements.push_back(candidate_no);
+					if (expanded_order > 2)
+						to_expand_next.push_back(candidate_no);
+				}
 			}
 		}
+		to_expand.swap(to_expand_next);
+		to_expand_next.clear();
 	}
 
 	if (choice.gnomon == nullptr) {
@@ -524,7 +692,50 @@ void Domain::compute_bspline_support(MeshType type, int order, Cube &e, int orig
 		choice.regular = new Bspline(x_knots, y_knots);
 	}
 
-	bsplines.push_back(choice);
+	support->choice = choice;
+}
+
+// Packs the supports of consecutive B-splines into per-element lists of the
+// B-splines covering them.
+void Domain::pack_element_bsplines(const vector<BsplineSupport> &supports) {
+	element_bspline_offsets.assign(elements.size() + 1, 0);
+	for (const auto& support: supports)
+		for (int e_no: support.elements)
+			element_bspline_offsets[e_no + 1]++;
+	for (unsigned i = 0; i < elements.size(); i++)
+		element_bspline_offsets[i + 1] += element_bspline_offsets[i];
+
+	element_bsplines.resize(element_bspline_offsets.back());
+	vector<int> next(element_bspline_offsets.begin(), element_bspline_offsets.end() - 1);
+	for (unsigned bspline_no = 0; bspline_no < supports.size(); bspline_no++)
+		for (int e_no: supports[bspline_no].elements)
+			element_bsplines[next[e_no]++] = bspline_no;
+}
+
+vector<int> Domain::get_element_bsplines(int e_num) const {
+	if (element_bspline_offsets.empty())
+		return vector<int>();
+	return vector<int>(
+			element_bsplines.begin() + element_bspline_offsets[e_num],
+			element_bsplines.begin() + element_bspline_offsets[e_num + 1]);
+}
+
+int Domain::locate_element(double x, double y) const {
+	return element_tree.locate(x, y);
+}
+
+void Domain::locate_bsplines(double x, double y, const int **begin, const int **end) const {
+	*begin = *end = element_bsplines.data();
+	int e_no = element_bspline_offsets.empty() ? -1 : locate_element(x, y);
+	if (e_no == -1)
+		return;
+	*begin = element_bsplines.data() + element_bspline_offsets[e_no];
+	*end = element_bsplines.data() + element_bspline_offsets[e_no + 1];
+}
+
+vector<int> Domain::get_bsplines_at(double x, double y) const {
+	int e_no = locate_element(x, y);
+	return e_no != -1 ? get_element_bsplines(e_no) : vector<int>();
 }
 
 Cube Domain::compute_not_defined_cube(const Cube &e, const Cube &support_cube) const {
@@ -566,39 +777,39 @@ Cube Domain::compute_not_defined_cube(const Cube &e, const Cube &support_cube) c
 void Domain::print_support_for_each_bspline() const {
 	vector<vector<Coord>> supports(elements.size());
 	for (const auto& e: elements) {
-		for (Coord bspline: e.get_bsplines()) {
+		for (Coord bspline: get_element_bsplines(e.get_num())) {
 			supports[bspline].push_back(e.get_num());
 		}
 	}
-	cout << elements.size() << endl;
+	*out << elements.size() << '\n';
 	for (unsigned i = 0; i < elements.size(); i++) {
 		const auto& e = elements[i];
-		cout << e.get_middle(X_DIM) << " " << e.get_middle(Y_DIM) << " ";
+		*out << e.get_middle(X_DIM) << " " << e.get_middle(Y_DIM) << " ";
 
 		const auto& support = supports[i];
-		cout << support.size() << " ";
+		*out << support.size() << " ";
 		for (auto& s: support)
-			cout << s << " ";
-		cout << endl;
+			*out << s << " ";
+		*out << '\n';
 	}
 }
 
 void Domain::print_knots_for_each_bspline() const {
-	cout << bsplines.size() << endl;
+	*out << bsplines.size() << '\n';
 	for (const BsplineChoice& choice: bsplines) {
 		if (choice.regular != nullptr) {
-			cout << "Regular ";
+			*out << "Regular ";
 			for (auto coord: choice.regular->get_x_knots())
-				cout << coord << " ";
+				*out << coord << " ";
 			for (auto coord: choice.regular->get_y_knots())
-				cout << coord << " ";
-			cout << endl;
+				*out << coord << " ";
+			*out << '\n';
 		} else {
 			const GnomonBspline& gb = *choice.gnomon;
-			cout << "Gnomon "
+			*out << "Gnomon "
 				<< gb.get_x_mid() << " " << gb.get_y_mid() << " "
 				<< gb.get_shift_x() << " " << gb.get_shift_y()
-				<< endl;
+				<< '\n';
 		}
 	}
 }
@@ -607,14 +818,24 @@ void Domain::print_bsplines_per_elements() const {
 	println_non_empty_elements_count();
 	for(auto& e : elements)
 		if (e.non_empty()) {
-			e.print_level_id_and_bsplines(e.get_id_within_level());
+			print_level_id_and_bsplines(e);
 		}
 }
 
+void Domain::print_level_id_and_bsplines(const Cube &e) const {
+	vector<int> e_bsplines = get_element_bsplines(e.get_num());
+	*out << e.get_level() << " ";
+	*out << e.get_id_within_level() << " ";
+	*out << e_bsplines.size();
+	for (int bspline: e_bsplines)
+		*out << " " << bspline + 1;
+	*out << '\n';
+}
+
 void Domain::print_bsplines_line_by_line() const {
-	cout << elements.size() << endl;
+	*out << elements.size() << '\n';
 	for (const auto& e: elements)
-		cout << e.get_num() + 1 << " " << 1 << endl;
+		*out << e.get_num() + 1 << " " << 1 << '\n';
 }
 
 
@@ -634,18 +855,18 @@ int Domain::compute_level(const Cube &cube) const {
 }
 
 void Domain::enumerate_all_elements() {
-	vector<Cube> old_elements;
-	elements.swap(old_elements);
+	compact_elements();
 	int i = 0;
-	for (const auto& e: old_elements) {
+	for (auto& e: elements) {
 		if (e.non_empty()) {
 			int level = compute_level(e);
 			int id = get_e_num_per_level_and_inc(level);
-			elements.push_back(Cube(e, i++, level, id, -1));
+			e = Cube(e, i++, level, id, -1);
 		} else {
-			elements.push_back(Cube(e, i++, -1, -1, -1));
+			e = Cube(e, i++, -1, -1, -1);
 		}
 	}
+	element_tree.build(elements, true);
 }
 
 void Domain::add_vertex_2D(Coord x, Coord y) {
@@ -658,9 +879,18 @@ void Domain::add_element_2D(Coord left, Coord right, Coord up, Coord down) {
 
 void Domain::add_element(const Cube &e) {
 	elements.push_back(e);
+	refinements.push_back(ElementRefinement());
 }
 
 
+void Domain::set_thread_count(int cnt) {
+	thread_cnt = cnt;
+}
+
+void Domain::set_output(TextWriter *_out) {
+	out = _out;
+}
+
 void Domain::allocate_elements_count_by_level_vector(int depth) {
 	elements_count_by_level.resize(depth + 1);
 }
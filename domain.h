@@ -8,6 +8,18 @@
 #include "node.h"
 #include "bspline.h"
 #include "bspline-non-rect.h"
+#include "element-index.h"
+#include "galois-format.h"
+#include "text-writer.h"
+
+// What becomes of the elimination tree's nodes as they are added: kept in
+// get_tree_nodes(), only counted, or printed as soon as their subtrees are
+// finished and then freed.
+enum TreeOutput {
+	STORE_TREE,
+	COUNT_TREE,
+	STREAM_TREE
+};
 
 enum MeshType {
 	UNEDGED,
@@ -28,6 +40,29 @@ struct BsplineChoice {
 			return regular->get_support();
 		return gnomon->get_support_as_cube();
 	}
+	const Function2D& get_function() const {
+		if (regular)
+			return *regular;
+		return *gnomon;
+	}
+};
+
+// How an element has been refined, until the elements are compacted.
+struct ElementRefinement {
+	// Whether the element has been split (or removed) and no longer counts.
+	bool dropped = false;
+	// Whether the element is a part of a split one.
+	bool is_child = false;
+	// Position of the first of the parts of a split element, and their count.
+	int first_child = 0, child_cnt = 0;
+};
+
+// Support of a B-spline, as computed for its central element.
+struct BsplineSupport {
+	// Elements covered by the B-spline, in the order they were found.
+	vector<int> elements;
+	// The B-spline itself.
+	BsplineChoice choice;
 };
 
 // -1, 0 or +1 depending on the sign of val
@@ -45,8 +80,6 @@ public:
 
 	bool is_vertical_side_element(const Cube &cube, Coord middle) const;
 
-	bool overlaps_with_any_other(const Cube &that) const;
-
 	void split_eight_side_elements_within_box_2D(Cube cube);
 
 	void split_elements_within_box_into_4_2D(const Cube &box);
@@ -75,11 +108,14 @@ public:
 
 	void print_galois_output() const;
 
+	// The same numbers as print_galois_output, collected into arrays.
+	void get_galois_mesh(GaloisMesh *mesh) const;
+
 	void print_tree_postorder(const Node*, vector<bool>* bspline_printed) const;
 
-	static void print_line(Coord x1, Coord y1, Coord x2, Coord y2);
+	void print_line(Coord x1, Coord y1, Coord x2, Coord y2) const;
 
-	static void print_tabs(int cnt);
+	void print_tabs(int cnt) const;
 
 	bool cubes_are_adjacent(const Cube &that, const Cube &other, int bound_no, bool looseened_conds) const;
 
@@ -99,10 +135,21 @@ public:
 
 	void tree_process_cut_off_box(int dim, Node *node, bool toggle_dim);
 
+	// To be called once all the descendants of the node have been added.
+	void finish_tree_node(Node *node);
+
+	// Starts a new tree, numbering its nodes from 0 again.
+	void set_tree_output(TreeOutput output);
+
+	// Nodes added since the tree was started.
+	int get_tree_node_count() const;
+
 	const vector<Node *> &get_tree_nodes() const;
 
 	void print_elements_per_tree_nodes() const;
 
+	void print_tree_node(const Node *node) const;
+
 	void print_tree_size() const;
 
 	void print_tree_for_draw() const;
@@ -117,7 +164,23 @@ public:
 
 	void compute_bsplines_supports(MeshType type, int order);
 
-	void compute_bspline_support(MeshType type, int order, Cube &e, int original_bspline_num);
+	void compute_bspline_support(MeshType type, int order, const Cube &e, int original_bspline_num,
+			vector<int> *last_bspline_added, BsplineSupport *support) const;
+
+	vector<Coord> compute_bspline_support_2D(const Cube &e) const;
+
+	vector<int> get_element_bsplines(int e_num) const;
+
+	// Position of the non-empty element containing the point (as found by
+	// ElementTree::locate), or -1 if the point is outside of the domain.
+	int locate_element(double x, double y) const;
+
+	// B-splines covering the element containing the point, which include all
+	// of those nonzero there, in ascending order as the range from *begin up
+	// to *end (empty outside of the domain).
+	void locate_bsplines(double x, double y, const int **begin, const int **end) const;
+
+	vector<int> get_bsplines_at(double x, double y) const;
 
 	void print_support_for_each_bspline() const;
 
@@ -125,6 +188,8 @@ public:
 
 	void print_bsplines_per_elements() const;
 
+	void print_level_id_and_bsplines(const Cube &e) const;
+
 	void print_bsplines_line_by_line() const;
 
 	int count_non_empty_elements() const;
@@ -135,6 +200,20 @@ public:
 
 	void allocate_elements_count_by_level_vector(int depth);
 
+	// Number of threads used by the phases which can run in parallel.
+	void set_thread_count(int cnt);
+
+	// Writer the print_* methods go through, standard_output() by default.
+	void set_output(TextWriter *_out);
+
+	const vector<Cube> &get_elements() const {
+		return elements;
+	}
+
+	const vector<BsplineChoice> &get_bsplines() const {
+		return bsplines;
+	}
+
 private:
 
 	void add_vertex_2D(Coord x, Coord y);
@@ -143,18 +222,65 @@ private:
 
 	void add_element(const Cube &e);
 
+	void replace_element(int e_no, const Cube *children, int child_cnt);
+
+	void compact_elements();
+
+	void append_compacted(int e_no, vector<Cube> *compacted) const;
+
 	int get_e_num_per_level_and_inc(int level) const;
+
+	void pack_element_bsplines(const vector<BsplineSupport> &supports);
 	Cube original_box;
 	vector<Cube> elements;
+	// Refinement of each of the elements, until enumerate_all_elements
+	// compacts them.
+	vector<ElementRefinement> refinements;
 	vector<Cube> cut_off_boxes;
 	vector<Node *> tree_nodes;
 	vector<BsplineChoice> bsplines;
+	// B-splines covering each element (must be separately computed), packed
+	// one list after another: those of the element i are element_bsplines at
+	// positions element_bspline_offsets[i] to element_bspline_offsets[i+1].
+	vector<int> element_bspline_offsets, element_bsplines;
+	// Elements' bounds from before tweaking, 2 * DIM_CNT per element.
+	vector<Coord> backed_up_bounds;
+	Cube backed_up_original_box;
+	// Elements by their bounds, for neighbor lookup.
+	BoundIndex bound_index;
+	// Non-empty elements, for B-spline support lookup and counting elements
+	// within tree nodes (built on enumeration).
+	ElementTree element_tree;
 
 	mutable vector<int> elements_count_by_level;
 
 	int tree_node_id = 0;
 
+	TreeOutput tree_output = STORE_TREE;
+
+	Node *tree_root = nullptr;
+
+	int thread_cnt = 1;
+
+	TextWriter *out = &standard_output();
+
 	Cube compute_not_defined_cube(const Cube &e, const Cube &support_cube) const;
 };
 
+// Looks up the domain's B-splines which may be nonzero at a point through the
+// element containing it.
+class DomainBsplineLocator : public SupportLocator {
+public:
+	DomainBsplineLocator(const Domain &_domain):
+		domain(_domain) {
+	}
+
+	void locate(double x, double y, const int **begin, const int **end) const {
+		domain.locate_bsplines(x, y, begin, end);
+	}
+
+private:
+	const Domain &domain;
+};
+
 #endif //BSPLINE_SINGULARITIES_GALOIS_DOMAIN_H
@@ -0,0 +1,192 @@
+#include <algorithm>
+
+#include "element-index.h"
+
+using namespace std;
+
+
+/*** BOUND INDEX ***/
+
+void BoundIndex::build(const vector<Cube> &elements) {
+	elements_by_bound.clear();
+	elements_by_bound.resize(DIM_CNT * 2);
+	for (unsigned i = 0; i < elements.size(); i++) {
+		const Cube& e = elements[i];
+		for (int bound_no = 0; bound_no < e.get_dim_cnt() * 2; bound_no++)
+			elements_by_bound[bound_no][e.get_bound(bound_no)].push_back(i);
+	}
+}
+
+const vector<int> &BoundIndex::get_elements_at(int bound_no, Coord coord) const {
+	if (bound_no >= (int) elements_by_bound.size())
+		return no_elements;
+	const auto& by_coord = elements_by_bound[bound_no];
+	auto it = by_coord.find(coord);
+	return it != by_coord.end() ? it->second : no_elements;
+}
+
+
+/*** ELEMENT TREE ***/
+
+static const int LEAF_SIZE = 8;
+
+void ElementTree::build(const vector<Cube> &_elements, bool non_empty_only) {
+	elements = &_elements;
+	indices.clear();
+	nodes.clear();
+	for (unsigned i = 0; i < _elements.size(); i++)
+		if (!non_empty_only || _elements[i].non_empty())
+			indices.push_back(i);
+	if (!indices.empty())
+		build_subtree(0, indices.size(), X_DIM);
+}
+
+int ElementTree::build_subtree(int begin, int end, int dim) {
+	int node_no = nodes.size();
+	nodes.push_back(TreeNode());
+	TreeNode node;
+	node.begin = begin;
+	node.end = end;
+	node.first = node.second = -1;
+	for (int d = 0; d < 2; d++) {
+		const Cube& e = (*elements)[indices[begin]];
+		node.min_from[d] = node.max_from[d] = e.get_from(d);
+		node.min_to[d] = node.max_to[d] = e.get_to(d);
+	}
+	for (int i = begin + 1; i < end; i++) {
+		const Cube& e = (*elements)[indices[i]];
+		for (int d = 0; d < 2; d++) {
+			node.min_from[d] = min(node.min_from[d], e.get_from(d));
+			node.max_from[d] = max(node.max_from[d], e.get_from(d));
+			node.min_to[d] = min(node.min_to[d], e.get_to(d));
+			node.max_to[d] = max(node.max_to[d], e.get_to(d));
+		}
+	}
+
+	if (end - begin > LEAF_SIZE) {
+		// Split at the median of the elements' middles in the given dimension.
+		int mid = (begin + end) / 2;
+		const vector<Cube>& es = *elements;
+		nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+				[&es, dim](int a, int b) {
+					Coord a_mid = es[a].get_from(dim) + es[a].get_to(dim);
+					Coord b_mid = es[b].get_from(dim) + es[b].get_to(dim);
+					return a_mid < b_mid || (a_mid == b_mid && a < b);
+				});
+		node.first = build_subtree(begin, mid, dim ^ 1);
+		node.second = build_subtree(mid, end, dim ^ 1);
+	}
+	nodes[node_no] = node;
+	return node_no;
+}
+
+void ElementTree::find_contained(const Cube &box, vector<int> *found) const {
+	found->clear();
+	if (!nodes.empty())
+		find_contained(0, box, found);
+	sort(found->begin(), found->end());
+}
+
+void ElementTree::find_contained(int node_no, const Cube &box, vector<int> *found) const {
+	const TreeNode& node = nodes[node_no];
+	bool all_contained = true;
+	for (int d = 0; d < 2; d++) {
+		if (node.max_from[d] < box.get_from(d) || box.get_to(d) < node.min_to[d])
+			return;  // each element sticks out of the box
+		if (node.min_from[d] < box.get_from(d) || box.get_to(d) < node.max_to[d])
+			all_contained = false;
+	}
+	if (all_contained || node.first == -1) {
+		for (int i = node.begin; i < node.end; i++) {
+			int index = indices[i];
+			if (all_contained || (*elements)[index].contained_in_box(box))
+				found->push_back(index);
+		}
+		return;
+	}
+	find_contained(node.first, box, found);
+	find_contained(node.second, box, found);
+}
+
+int ElementTree::count_contained(const Cube &box) const {
+	return nodes.empty() ? 0 : count_contained(0, box);
+}
+
+// Subtrees lying entirely within the box are counted without descending.
+int ElementTree::count_contained(int node_no, const Cube &box) const {
+	const TreeNode& node = nodes[node_no];
+	bool all_contained = true;
+	for (int d = 0; d < 2; d++) {
+		if (node.max_from[d] < box.get_from(d) || box.get_to(d) < node.min_to[d])
+			return 0;
+		if (node.min_from[d] < box.get_from(d) || box.get_to(d) < node.max_to[d])
+			all_contained = false;
+	}
+	if (all_contained)
+		return node.end - node.begin;
+	if (node.first == -1) {
+		int count = 0;
+		for (int i = node.begin; i < node.end; i++)
+			if ((*elements)[indices[i]].contained_in_box(box))
+				count++;
+		return count;
+	}
+	return count_contained(node.first, box) + count_contained(node.second, box);
+}
+
+void ElementTree::find_overlapping(const Cube &box, Coord spread_by, vector<int> *found) const {
+	found->clear();
+	if (!nodes.empty())
+		find_overlapping(0, box, spread_by, found);
+	sort(found->begin(), found->end());
+}
+
+void ElementTree::find_overlapping(int node_no, const Cube &box, Coord spread_by, vector<int> *found) const {
+	const TreeNode& node = nodes[node_no];
+	for (int d = 0; d < 2; d++)
+		if (box.get_to(d) <= node.min_from[d] - spread_by || node.max_to[d] + spread_by <= box.get_from(d))
+			return;
+	if (node.first == -1) {
+		for (int i = node.begin; i < node.end; i++) {
+			Cube other = (*elements)[indices[i]];
+			other.spread(spread_by);
+			if (box.overlaps_with(other))
+				found->push_back(indices[i]);
+		}
+		return;
+	}
+	find_overlapping(node.first, box, spread_by, found);
+	find_overlapping(node.second, box, spread_by, found);
+}
+
+int ElementTree::locate(double x, double y) const {
+	if (nodes.empty())
+		return -1;
+	int found = locate(0, x, y, false);
+	return found != -1 ? found : locate(0, x, y, true);
+}
+
+// Elements do not overlap, so at most a few of them (touching the point with
+// their bounds) contain it, and descending into the subtrees whose ranges
+// cover the point visits O(log N) nodes.
+int ElementTree::locate(int node_no, double x, double y, bool closed) const {
+	const TreeNode& node = nodes[node_no];
+	double point[2] = { x, y };
+	for (int d = 0; d < 2; d++)
+		if (point[d] < node.min_from[d] || node.max_to[d] < point[d])
+			return -1;
+	if (node.first == -1) {
+		for (int i = node.begin; i < node.end; i++) {
+			const Cube& e = (*elements)[indices[i]];
+			bool contains = true;
+			for (int d = 0; d < 2; d++)
+				if (point[d] < e.get_from(d) || e.get_to(d) < point[d] || (!closed && point[d] == e.get_to(d)))
+					contains = false;
+			if (contains)
+				return indices[i];
+		}
+		return -1;
+	}
+	int found = locate(node.first, x, y, closed);
+	return found != -1 ? found : locate(node.second, x, y, closed);
+}
@@ -0,0 +1,81 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_ELEMENTINDEX_H
+#define BSPLINE_SINGULARITIES_GALOIS_ELEMENTINDEX_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "cube.h"
+
+// Elements hashed by the coordinate of each of their bounds, so that all the
+// elements touching the given line can be found without scanning them all.
+class BoundIndex {
+public:
+
+	void build(const vector<Cube> &elements);
+
+	// Positions of the elements whose `bound_no' bound lies at `coord', in
+	// ascending order.
+	const vector<int> &get_elements_at(int bound_no, Coord coord) const;
+
+private:
+
+	vector<unordered_map<Coord, vector<int>>> elements_by_bound;
+	vector<int> no_elements;
+};
+
+// A static 2D k-d tree over the elements' bounds, answering range queries
+// about elements with their positions in the elements' vector. It must be
+// rebuilt whenever the elements are moved or resized.
+class ElementTree {
+public:
+
+	void build(const vector<Cube> &elements, bool non_empty_only);
+
+	// Puts positions of all the indexed elements fully contained within the
+	// given box into `found', in ascending order.
+	void find_contained(const Cube &box, vector<int> *found) const;
+
+	// Number of the indexed elements fully contained within the given box.
+	int count_contained(const Cube &box) const;
+
+	// Puts positions of all the indexed elements which would overlap with the
+	// given box if each of their bounds was spread by `spread_by' into `found'.
+	// Since the positions are looked up by the bounds from the time the tree
+	// was built, elements spread since then by no more than `spread_by' are
+	// still found.
+	void find_overlapping(const Cube &box, Coord spread_by, vector<int> *found) const;
+
+	// Position of the indexed element containing the point, or -1 if there is
+	// none. Elements are taken as closed at their `from' bounds and open at
+	// their `to' ones, unless no element contains the point that way (as at
+	// the far bounds of the domain), in which case as closed at both.
+	int locate(double x, double y) const;
+
+private:
+
+	struct TreeNode {
+		// Per dimension: the ranges of the elements' `from' and `to' bounds.
+		Coord min_from[2], max_from[2], min_to[2], max_to[2];
+		// Range of positions within `indices', and children (-1 for leaves).
+		int begin, end;
+		int first, second;
+	};
+
+	int build_subtree(int begin, int end, int dim);
+
+	void find_contained(int node_no, const Cube &box, vector<int> *found) const;
+
+	int count_contained(int node_no, const Cube &box) const;
+
+	void find_overlapping(int node_no, const Cube &box, Coord spread_by, vector<int> *found) const;
+
+	// The first element found containing the point, as half-open ones or as
+	// closed ones, depending on `closed'.
+	int locate(int node_no, double x, double y, bool closed) const;
+
+	const vector<Cube> *elements = nullptr;
+	vector<int> indices;
+	vector<TreeNode> nodes;
+};
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_ELEMENTINDEX_H
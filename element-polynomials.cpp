@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "element-polynomials.h"
+#include "parallel.h"
+
+using namespace std;
+
+
+/*** FITTING ***/
+
+// Degree of the B-splines of the domain in each of the dimensions, which is
+// the degree of their pieces.
+static int get_bspline_degree(const BsplineChoice &choice) {
+	if (choice.regular)
+		return max(choice.regular->get_x_knots().size(), choice.regular->get_y_knots().size()) - 2;
+	return 2;  // all the parts of a gnomon B-spline are quadratic
+}
+
+// Inverse of the n x n matrix `m' (row by row), by Gauss-Jordan elimination.
+static vector<double> invert(vector<double> m, int n) {
+	vector<double> inverse(n * n, 0.0);
+	for (int i = 0; i < n; i++)
+		inverse[i * n + i] = 1.0;
+	for (int col = 0; col < n; col++) {
+		int pivot = col;
+		for (int row = col + 1; row < n; row++)
+			if (fabs(m[row * n + col]) > fabs(m[pivot * n + col]))
+				pivot = row;
+		for (int k = 0; k < n; k++) {
+			swap(m[col * n + k], m[pivot * n + k]);
+			swap(inverse[col * n + k], inverse[pivot * n + k]);
+		}
+		double scale = 1.0 / m[col * n + col];
+		for (int k = 0; k < n; k++) {
+			m[col * n + k] *= scale;
+			inverse[col * n + k] *= scale;
+		}
+		for (int row = 0; row < n; row++) {
+			if (row == col)
+				continue;
+			double factor = m[row * n + col];
+			for (int k = 0; k < n; k++) {
+				m[row * n + k] -= factor * m[col * n + k];
+				inverse[row * n + k] -= factor * inverse[col * n + k];
+			}
+		}
+	}
+	return inverse;
+}
+
+void ElementPolynomials::build(const Domain &domain, int thread_cnt) {
+	const vector<Cube> &elements = domain.get_elements();
+	degree = 0;
+	for (const BsplineChoice &choice: domain.get_bsplines())
+		degree = max(degree, get_bspline_degree(choice));
+	assert(degree <= MAX_DEGREE);
+
+	// Interpolate at the middles of n equal parts of each dimension, away
+	// from the bounds, where masked parts of gnomon B-splines may jump.
+	int n = degree + 1;
+	nodes.resize(n);
+	vector<double> vandermonde(n * n);
+	for (int a = 0; a < n; a++) {
+		nodes[a] = (a + 0.5) / n;
+		compute_powers(nodes[a], &vandermonde[a * n]);
+	}
+	inverse_vandermonde = invert(vandermonde, n);
+
+	cell_offsets.assign(1, 0);
+	piece_offsets.assign(1, 0);
+	cell_boxes.clear();
+	vector<int> cell_elements;
+	for (unsigned i = 0; i < elements.size(); i++) {
+		if (elements[i].non_empty()) {
+			vector<double> x_breaks = get_breaks(domain, i, X_DIM);
+			vector<double> y_breaks = get_breaks(domain, i, Y_DIM);
+			int piece_cnt = domain.get_element_bsplines(i).size();
+			for (unsigned xi = 0; xi + 1 < x_breaks.size(); xi++)
+				for (unsigned yi = 0; yi + 1 < y_breaks.size(); yi++) {
+					cell_boxes.insert(cell_boxes.end(), {
+							x_breaks[xi], x_breaks[xi + 1], y_breaks[yi], y_breaks[yi + 1] });
+					cell_elements.push_back(i);
+					piece_offsets.push_back(piece_offsets.back() + piece_cnt);
+				}
+		}
+		cell_offsets.push_back(cell_elements.size());
+	}
+	piece_bsplines.resize(piece_offsets.back());
+	coefs.resize(piece_offsets.back() * get_coef_count());
+
+	vector<double> errors(cell_elements.size(), 0.0);
+	parallel_for(cell_elements.size(), thread_cnt, [&](int from, int to) {
+		for (int cell = from; cell < to; cell++)
+			fit_cell(domain, domain.get_element_bsplines(cell_elements[cell]), cell, &errors[cell]);
+	});
+	max_fit_error = 0.0;
+	for (double error: errors)
+		max_fit_error = max(max_fit_error, error);
+}
+
+// Bounds of the element in the given dimension, and all the lines within it
+// along which any of its B-splines breaks, in ascending order.
+vector<double> ElementPolynomials::get_breaks(const Domain &domain, int e_no, int dim) const {
+	const Cube &e = domain.get_elements()[e_no];
+	double from = e.get_from(dim), to = e.get_to(dim);
+	vector<double> breaks = { from, to };
+	for (int bspline: domain.get_element_bsplines(e_no)) {
+		const BsplineChoice &choice = domain.get_bsplines()[bspline];
+		vector<double> lines;
+		if (choice.regular) {
+			lines = dim == X_DIM ? choice.regular->get_x_knots() : choice.regular->get_y_knots();
+		} else {
+			const GnomonBsplineCoords &c = choice.gnomon->get_coords();
+			if (dim == X_DIM)
+				lines = { c.x_from(), c.x_mid, c.x_pivot(), c.x_to() };
+			else
+				lines = { c.y_from(), c.y_mid, c.y_pivot(), c.y_to() };
+		}
+		for (double line: lines)
+			if (from < line && line < to)
+				breaks.push_back(line);
+	}
+	sort(breaks.begin(), breaks.end());
+	breaks.erase(unique(breaks.begin(), breaks.end()), breaks.end());
+	return breaks;
+}
+
+// Coefficients are C = V^-1 F V^-T, where F holds the values at the grid of
+// nodes and V the powers of the nodes.
+void ElementPolynomials::fit_cell(const Domain &domain, const vector<int> &e_bsplines, int cell, double *error) {
+	const double *box = get_cell_box(cell);
+	double width = box[1] - box[0], height = box[3] - box[2];
+	int n = degree + 1;
+	vector<double> values(n * n), partial(n * n);
+	for (unsigned k = 0; k < e_bsplines.size(); k++) {
+		int piece = piece_offsets[cell] + k;
+		piece_bsplines[piece] = e_bsplines[k];
+		const Function2D &f = domain.get_bsplines()[e_bsplines[k]].get_function();
+
+		for (int a = 0; a < n; a++)
+			for (int b = 0; b < n; b++)
+				values[a * n + b] = f.apply(box[0] + nodes[a] * width, box[2] + nodes[b] * height);
+		// partial = V^-1 F, then C = partial V^-T
+		for (int i = 0; i < n; i++)
+			for (int b = 0; b < n; b++) {
+				double sum = 0.0;
+				for (int a = 0; a < n; a++)
+					sum += inverse_vandermonde[i * n + a] * values[a * n + b];
+				partial[i * n + b] = sum;
+			}
+		double *c = &coefs[piece * get_coef_count()];
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < n; j++) {
+				double sum = 0.0;
+				for (int b = 0; b < n; b++)
+					sum += partial[i * n + b] * inverse_vandermonde[j * n + b];
+				c[i * n + j] = sum;
+			}
+
+		// Check the fit in between the nodes.
+		for (int a = 0; a <= n; a++)
+			for (int b = 0; b <= n; b++) {
+				double x = box[0] + (a + 1.0) / (n + 2) * width;
+				double y = box[2] + (b + 1.0) / (n + 2) * height;
+				*error = max(*error, fabs(evaluate(cell, piece, x, y) - f.apply(x, y)));
+			}
+	}
+}
+
+
+/*** EVALUATION ***/
+
+void ElementPolynomials::compute_powers(double t, double *powers) const {
+	powers[0] = 1.0;
+	for (int i = 1; i <= degree; i++)
+		powers[i] = powers[i - 1] * t;
+}
+
+// Cells of an element go along y within x, so the last one starting at or
+// before the point in both dimensions contains it.
+int ElementPolynomials::find_cell(int e_no, double x, double y) const {
+	int found = cell_offsets[e_no];
+	for (int cell = cell_offsets[e_no]; cell < cell_offsets[e_no + 1]; cell++)
+		if (cell_boxes[4 * cell] <= x && cell_boxes[4 * cell + 2] <= y)
+			found = cell;
+	return found;
+}
+
+double ElementPolynomials::evaluate_piece(const double *c, const double *u_powers, const double *v_powers) const {
+	int n = degree + 1;
+	double result = 0.0;
+	for (int i = 0; i < n; i++) {
+		double row = 0.0;
+		for (int j = 0; j < n; j++)
+			row += c[i * n + j] * v_powers[j];
+		result += u_powers[i] * row;
+	}
+	return result;
+}
+
+double ElementPolynomials::evaluate(int cell, int piece, double x, double y) const {
+	assert(piece_offsets[cell] <= piece && piece < piece_offsets[cell + 1]);
+	double u_powers[MAX_DEGREE + 1], v_powers[MAX_DEGREE + 1];
+	compute_powers(get_u(cell, x), u_powers);
+	compute_powers(get_v(cell, y), v_powers);
+	return evaluate_piece(get_coefs(piece), u_powers, v_powers);
+}
+
+// Powers of the local coordinates are shared by all the pieces.
+void ElementPolynomials::evaluate_all(int cell, double x, double y, double *values) const {
+	double u_powers[MAX_DEGREE + 1], v_powers[MAX_DEGREE + 1];
+	compute_powers(get_u(cell, x), u_powers);
+	compute_powers(get_v(cell, y), v_powers);
+	for (int piece = piece_offsets[cell]; piece < piece_offsets[cell + 1]; piece++)
+		values[piece - piece_offsets[cell]] = evaluate_piece(get_coefs(piece), u_powers, v_powers);
+}
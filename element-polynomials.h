@@ -0,0 +1,135 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_ELEMENTPOLYNOMIALS_H
+#define BSPLINE_SINGULARITIES_GALOIS_ELEMENTPOLYNOMIALS_H
+
+#include <vector>
+
+#include "domain.h"
+
+using namespace std;
+
+// B-splines of a domain restricted to the cells of its non-empty elements,
+// over each of which every one of them is a polynomial of degree at most
+// `degree' in each of the dimensions. An element is a single cell unless
+// some gnomon B-spline breaks within it (at its middle, pivot or support
+// bounds), in which case it is cut into cells along all such lines.
+//
+// Each piece of a B-spline over a cell is kept as its coefficients in the
+// power basis u^i v^j of coordinates local to the cell (u = 0 at its left and
+// 1 at its right, v likewise between its up and down bounds), so that
+// evaluating it takes no knot span lookups, masks nor virtual calls.
+class ElementPolynomials {
+public:
+
+	// Highest degree of B-splines' knots (see Knots).
+	static const int MAX_DEGREE = Knots::MAX_CNT - 2;
+
+	// Fits the pieces of the B-splines covering the elements, as computed by
+	// Domain::compute_bsplines_supports, by interpolation at (degree + 1)^2
+	// points within each cell.
+	void build(const Domain &domain, int thread_cnt);
+
+	int get_degree() const {
+		return degree;
+	}
+
+	// Coefficients per piece, (degree + 1)^2; c[i * (degree + 1) + j] is that
+	// of u^i v^j.
+	int get_coef_count() const {
+		return (degree + 1) * (degree + 1);
+	}
+
+	int get_element_count() const {
+		return cell_offsets.size() - 1;
+	}
+
+	// Cells of the element `e_no' are those at positions from
+	// get_cells_begin(e_no) up to get_cells_end(e_no), none for empty ones.
+	int get_cells_begin(int e_no) const {
+		return cell_offsets[e_no];
+	}
+
+	int get_cells_end(int e_no) const {
+		return cell_offsets[e_no + 1];
+	}
+
+	int get_cell_count() const {
+		return piece_offsets.size() - 1;
+	}
+
+	int get_piece_count() const {
+		return piece_offsets.back();
+	}
+
+	// x_from, x_to, y_from, y_to of the cell.
+	const double *get_cell_box(int cell) const {
+		return &cell_boxes[4 * cell];
+	}
+
+	// Cell of the element `e_no' containing the point, cells being closed at
+	// their left and up bounds and open at the others, but for those at the
+	// element's right or down bound.
+	int find_cell(int e_no, double x, double y) const;
+
+	// Pieces of the cell are those at positions from get_pieces_begin(cell)
+	// up to get_pieces_end(cell), in the order of Domain::get_element_bsplines.
+	int get_pieces_begin(int cell) const {
+		return piece_offsets[cell];
+	}
+
+	int get_pieces_end(int cell) const {
+		return piece_offsets[cell + 1];
+	}
+
+	// Position within the domain's B-splines of the one the piece is part of.
+	int get_bspline(int piece) const {
+		return piece_bsplines[piece];
+	}
+
+	const double *get_coefs(int piece) const {
+		return &coefs[piece * get_coef_count()];
+	}
+
+	// Local coordinates of a point of the cell.
+	double get_u(int cell, double x) const {
+		return (x - cell_boxes[4 * cell]) / (cell_boxes[4 * cell + 1] - cell_boxes[4 * cell]);
+	}
+
+	double get_v(int cell, double y) const {
+		return (y - cell_boxes[4 * cell + 2]) / (cell_boxes[4 * cell + 3] - cell_boxes[4 * cell + 2]);
+	}
+
+	// Value at (x, y) of the given piece of the cell.
+	double evaluate(int cell, int piece, double x, double y) const;
+
+	// Values at (x, y) of all the pieces of the cell, into values[0] up to
+	// values[get_pieces_end(cell) - get_pieces_begin(cell) - 1].
+	void evaluate_all(int cell, double x, double y, double *values) const;
+
+	// Greatest difference between the pieces and the B-splines at points
+	// other than those interpolated at, nonzero if some B-spline is not
+	// a polynomial over a cell.
+	double get_max_fit_error() const {
+		return max_fit_error;
+	}
+
+private:
+
+	vector<double> get_breaks(const Domain &domain, int e_no, int dim) const;
+
+	void fit_cell(const Domain &domain, const vector<int> &e_bsplines, int cell, double *error);
+
+	double evaluate_piece(const double *c, const double *u_powers, const double *v_powers) const;
+
+	// Puts powers of `t', from t^0 to t^degree, into `powers'.
+	void compute_powers(double t, double *powers) const;
+
+	int degree = 0;
+	// Local coordinates of the points interpolated at, along each dimension,
+	// and the inverse of the Vandermonde matrix of their powers.
+	vector<double> nodes, inverse_vandermonde;
+	vector<int> cell_offsets, piece_offsets, piece_bsplines;
+	vector<double> cell_boxes, coefs;
+	double max_fit_error = 0.0;
+};
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_ELEMENTPOLYNOMIALS_H
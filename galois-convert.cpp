@@ -0,0 +1,33 @@
+#include <iostream>
+using namespace std;
+
+#include "galois-format.h"
+
+// Converts a mesh between the text format printed by `generate --galois'
+// and the binary one of `generate --galois-binary', printing the result.
+int main(int argc, char** argv) {
+	if (argc != 3 || (string(argv[1]) != "--to-binary" && string(argv[1]) != "--to-text")) {
+		cerr << "usage: " << argv[0] << " --to-binary|--to-text FILE" << endl;
+		return 1;
+	}
+	string path(argv[2]);
+
+	if (string(argv[1]) == "--to-binary") {
+		GaloisMesh mesh;
+		string error;
+		if (!mesh.read_text_file(path, &error)) {
+			cerr << error << endl;
+			return 1;
+		}
+		mesh.get_view().write_binary(cout);
+	} else {
+		MappedGaloisFile file;
+		string error;
+		if (!file.open(path, &error)) {
+			cerr << error << endl;
+			return 1;
+		}
+		file.get_view().print_text(cout);
+	}
+	return 0;
+}
@@ -0,0 +1,560 @@
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "galois-format.h"
+
+using namespace std;
+
+static const char MAGIC[8] = { 'G', 'A', 'L', 'O', 'I', 'S', 'B', 'N' };
+static const int SECTION_CNT = 3;
+static const char SECTION_TAGS[SECTION_CNT][4] = {
+	{ 'B', 'S', 'P', 'L' }, { 'E', 'L', 'E', 'M' }, { 'T', 'R', 'E', 'E' } };
+
+
+/*** TEXT ***/
+
+void GaloisMeshView::print_text(ostream &out) const {
+	out << bspline_cnt << '\n';
+	for (int i = 0; i < bspline_cnt; i++)
+		out << bspline_ids[i] << " " << bspline_flags[i] << '\n';
+
+	out << element_cnt << '\n';
+	for (int i = 0; i < element_cnt; i++) {
+		out << element_levels[i] << " " << element_ids[i] << " "
+			<< element_bspline_offsets[i + 1] - element_bspline_offsets[i];
+		for (int k = element_bspline_offsets[i]; k < element_bspline_offsets[i + 1]; k++)
+			out << " " << element_bsplines[k];
+		out << '\n';
+	}
+
+	out << node_cnt << '\n';
+	for (int i = 0; i < node_cnt; i++) {
+		out << node_ids[i] << " " << node_element_offsets[i + 1] - node_element_offsets[i] << " ";
+		for (int k = node_element_offsets[i]; k < node_element_offsets[i + 1]; k++)
+			out << node_element_levels[k] << " " << node_element_ids[k] << " ";
+		for (int k = node_child_offsets[i]; k < node_child_offsets[i + 1]; k++)
+			out << node_children[k] << " ";
+		out << '\n';
+	}
+}
+
+// Scans the numbers of a text in memory, skipping whitespace and comments.
+class TextScanner {
+public:
+	TextScanner(const char *_position, const char *_end):
+		position(_position), end(_end) {
+	}
+
+	bool next(int32_t *number) {
+		skip();
+		bool negative = position != end && *position == '-';
+		if (negative)
+			position++;
+		if (position == end || !is_digit(*position))
+			return false;
+		int64_t value = 0;
+		while (position != end && is_digit(*position)) {
+			value = value * 10 + (*position++ - '0');
+			if (value > (int64_t) INT32_MAX + 1)
+				return false;
+		}
+		if (position != end && !is_space(*position) && *position != '#')
+			return false;
+		value = negative ? -value : value;
+		if (value > INT32_MAX)
+			return false;
+		*number = value;
+		return true;
+	}
+
+	// Next number, which must not be negative.
+	bool next_count(int32_t *cnt) {
+		return next(cnt) && *cnt >= 0;
+	}
+
+	// Upper bound on the count of numbers left, for reserving space.
+	size_t get_max_remaining() const {
+		return (end - position) / 2 + 1;
+	}
+
+	bool at_end() {
+		skip();
+		return position == end;
+	}
+
+	// Line of the input (counting from 1) the scanning got to.
+	int get_line() const {
+		return line;
+	}
+
+	// Line of the next number.
+	int get_next_line() {
+		skip();
+		return line;
+	}
+
+private:
+
+	static bool is_digit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	static bool is_space(char c) {
+		return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	void skip() {
+		while (position != end) {
+			if (*position == '#') {
+				const char *line_end = (const char*) memchr(position, '\n', end - position);
+				position = line_end != nullptr ? line_end : end;
+			} else if (is_space(*position)) {
+				line += *position == '\n';
+				position++;
+			} else {
+				break;
+			}
+		}
+	}
+
+	const char *position, *end;
+	int line = 1;
+};
+
+// Reports where parsing stopped, returning false.
+static bool parse_failure(const TextScanner &scanner, const string &what, string *error) {
+	*error = "cannot read " + what + " at line " + to_string(scanner.get_line());
+	return false;
+}
+
+static uint64_t element_key(int32_t level, int32_t id) {
+	return (uint64_t) (uint32_t) level << 32 | (uint32_t) id;
+}
+
+// After a node which does not have exactly the two children the text format
+// allows for, the following numbers are read shifted, so the first record
+// referring to undefined nodes or elements is most likely the one after it.
+static int find_misaligned_node(const GaloisMesh &mesh, int node_cnt) {
+	unordered_map<uint64_t, int> elements_by_key(mesh.element_levels.size());
+	for (unsigned i = 0; i < mesh.element_levels.size(); i++)
+		elements_by_key.emplace(element_key(mesh.element_levels[i], mesh.element_ids[i]), i);
+	vector<bool> id_seen(node_cnt, false);
+	// Nodes read completely, as the last one may have been cut short.
+	for (unsigned i = 0; i + 1 < mesh.node_child_offsets.size(); i++) {
+		int32_t id = mesh.node_ids[i];
+		if (id < 1 || id > node_cnt || id_seen[id - 1])
+			return i;
+		id_seen[id - 1] = true;
+		for (int k = mesh.node_element_offsets[i]; k < mesh.node_element_offsets[i + 1]; k++)
+			if (elements_by_key.count(element_key(mesh.node_element_levels[k], mesh.node_element_ids[k])) == 0)
+				return i;
+		for (int k = mesh.node_child_offsets[i]; k < mesh.node_child_offsets[i + 1]; k++)
+			if (mesh.node_children[k] < 1 || mesh.node_children[k] > node_cnt)
+				return i;
+	}
+	return -1;
+}
+
+// Points a failure within the tree section at its likely cause.
+static bool tree_parse_failure(const TextScanner &scanner, const string &what, const GaloisMesh &mesh,
+		const vector<int> &node_lines, int node_cnt, string *error) {
+	parse_failure(scanner, what, error);
+	int misaligned = find_misaligned_node(mesh, node_cnt);
+	if (misaligned > 0)
+		*error = "probably a non-binary tree node at line " + to_string(node_lines[misaligned - 1])
+				+ ": the record after it (line " + to_string(node_lines[misaligned])
+				+ ") refers to undefined nodes or elements, and then " + *error;
+	return false;
+}
+
+bool GaloisMesh::read_text(const char *text, size_t size, string *error) {
+	*this = GaloisMesh();
+	TextScanner scanner(text, text + size);
+	int32_t cnt, value;
+	if (!scanner.next_count(&cnt))
+		return parse_failure(scanner, "the B-spline count", error);
+	bspline_ids.reserve(min((size_t) cnt, scanner.get_max_remaining()));
+	bspline_flags.reserve(bspline_ids.capacity());
+	for (int i = 0; i < cnt; i++) {
+		int32_t id, flag;
+		if (!scanner.next(&id) || !scanner.next(&flag))
+			return parse_failure(scanner, "B-spline " + to_string(i + 1), error);
+		bspline_ids.push_back(id);
+		bspline_flags.push_back(flag);
+	}
+
+	if (!scanner.next_count(&cnt))
+		return parse_failure(scanner, "the element count", error);
+	element_levels.reserve(min((size_t) cnt, scanner.get_max_remaining()));
+	element_ids.reserve(element_levels.capacity());
+	element_bspline_offsets.reserve(element_levels.capacity() + 1);
+	for (int i = 0; i < cnt; i++) {
+		int32_t level, id, bspline_cnt;
+		if (!scanner.next(&level) || !scanner.next(&id) || !scanner.next_count(&bspline_cnt))
+			return parse_failure(scanner, "element " + to_string(i + 1), error);
+		element_levels.push_back(level);
+		element_ids.push_back(id);
+		for (int k = 0; k < bspline_cnt; k++) {
+			if (!scanner.next(&value))
+				return parse_failure(scanner, "B-splines of element " + to_string(i + 1), error);
+			element_bsplines.push_back(value);
+		}
+		element_bspline_offsets.push_back(element_bsplines.size());
+	}
+
+	if (!scanner.next_count(&cnt))
+		return parse_failure(scanner, "the tree node count", error);
+	node_ids.reserve(min((size_t) cnt, scanner.get_max_remaining()));
+	node_element_offsets.reserve(node_ids.capacity() + 1);
+	node_child_offsets.reserve(node_ids.capacity() + 1);
+	// Only kept for pointing errors at their causes.
+	vector<int> node_lines;
+	node_lines.reserve(node_ids.capacity());
+	for (int i = 0; i < cnt; i++) {
+		int32_t id, element_cnt;
+		node_lines.push_back(scanner.get_next_line());
+		if (!scanner.next(&id) || !scanner.next_count(&element_cnt))
+			return tree_parse_failure(scanner, "tree node " + to_string(i + 1), *this, node_lines, cnt, error);
+		node_ids.push_back(id);
+		for (int k = 0; k < element_cnt; k++) {
+			int32_t level;
+			if (!scanner.next(&level) || !scanner.next(&id))
+				return tree_parse_failure(scanner, "elements of tree node " + to_string(i + 1), *this, node_lines,
+						cnt, error);
+			node_element_levels.push_back(level);
+			node_element_ids.push_back(id);
+		}
+		node_element_offsets.push_back(node_element_levels.size());
+		// The tree is binary, see the format's description.
+		for (int k = 0; element_cnt > 1 && k < 2; k++) {
+			if (!scanner.next(&value))
+				return tree_parse_failure(scanner, "the two children of tree node " + to_string(i + 1), *this,
+						node_lines, cnt, error);
+			node_children.push_back(value);
+		}
+		node_child_offsets.push_back(node_children.size());
+	}
+
+	// Nothing but comments may follow.
+	if (!scanner.at_end())
+		return tree_parse_failure(scanner, "the end of the file", *this, node_lines, cnt, error);
+	return true;
+}
+
+// Maps the whole file read-only, or sets `error' and returns nullptr.
+static void *map_file(const string &path, size_t *size, string *error) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		*error = "cannot open " + path;
+		return nullptr;
+	}
+	void *data = nullptr;
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+		*size = file_stat.st_size;
+		data = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+			data = nullptr;
+	}
+	close(fd);
+	if (data == nullptr)
+		*error = "cannot map " + path;
+	return data;
+}
+
+bool GaloisMesh::read_text_file(const string &path, string *error) {
+	size_t size;
+	void *data = map_file(path, &size, error);
+	if (data == nullptr)
+		return false;
+	madvise(data, size, MADV_SEQUENTIAL);
+	bool ok = read_text((const char*) data, size, error);
+	munmap(data, size);
+	if (!ok)
+		*error = path + ": " + *error;
+	return ok;
+}
+
+GaloisMeshView GaloisMesh::get_view() const {
+	GaloisMeshView view;
+	view.bspline_cnt = bspline_ids.size();
+	view.bspline_ids = bspline_ids.data();
+	view.bspline_flags = bspline_flags.data();
+	view.element_cnt = element_levels.size();
+	view.element_levels = element_levels.data();
+	view.element_ids = element_ids.data();
+	view.element_bspline_offsets = element_bspline_offsets.data();
+	view.element_bsplines = element_bsplines.data();
+	view.node_cnt = node_ids.size();
+	view.node_ids = node_ids.data();
+	view.node_element_offsets = node_element_offsets.data();
+	view.node_element_levels = node_element_levels.data();
+	view.node_element_ids = node_element_ids.data();
+	view.node_child_offsets = node_child_offsets.data();
+	view.node_children = node_children.data();
+	return view;
+}
+
+
+/*** BINARY ***/
+
+// Arrays making up a section's payload, following its count.
+struct SectionArray {
+	const int32_t *values;
+	int cnt;
+};
+
+static void write_section(ostream &out, const char *tag, int cnt, const vector<SectionArray> &arrays) {
+	uint64_t length = sizeof(int32_t);
+	for (const SectionArray &array: arrays)
+		length += array.cnt * sizeof(int32_t);
+	uint64_t padding = (8 - length % 8) % 8;
+	uint64_t padded_length = length + padding;
+	const char zeros[8] = { 0 };
+
+	out.write(tag, 4);
+	out.write(zeros, 4);
+	out.write((const char*) &padded_length, sizeof(padded_length));
+	int32_t cnt32 = cnt;
+	out.write((const char*) &cnt32, sizeof(cnt32));
+	for (const SectionArray &array: arrays)
+		out.write((const char*) array.values, array.cnt * sizeof(int32_t));
+	out.write(zeros, padding);
+}
+
+void GaloisMeshView::write_binary(ostream &out) const {
+	uint32_t header[2] = { GALOIS_FORMAT_VERSION, SECTION_CNT };
+	out.write(MAGIC, sizeof(MAGIC));
+	out.write((const char*) header, sizeof(header));
+
+	int element_bspline_cnt = element_bspline_offsets[element_cnt];
+	int node_element_cnt = node_element_offsets[node_cnt];
+	int node_child_cnt = node_child_offsets[node_cnt];
+	write_section(out, SECTION_TAGS[0], bspline_cnt, {
+			{ bspline_ids, bspline_cnt }, { bspline_flags, bspline_cnt } });
+	write_section(out, SECTION_TAGS[1], element_cnt, {
+			{ element_levels, element_cnt }, { element_ids, element_cnt },
+			{ element_bspline_offsets, element_cnt + 1 }, { element_bsplines, element_bspline_cnt } });
+	write_section(out, SECTION_TAGS[2], node_cnt, {
+			{ node_ids, node_cnt }, { node_element_offsets, node_cnt + 1 },
+			{ node_element_levels, node_element_cnt }, { node_element_ids, node_element_cnt },
+			{ node_child_offsets, node_cnt + 1 }, { node_children, node_child_cnt } });
+}
+
+// Reads the payload of a section in place: its count, then the arrays one
+// after another, the sizes of later ones possibly given by the offsets within
+// earlier ones. Returns false if they do not fit within the payload.
+class SectionReader {
+public:
+	SectionReader(const char *_payload, uint64_t _length):
+		payload(_payload), length(_length) {
+	}
+
+	bool read_count(int *cnt) {
+		const int32_t *value;
+		if (!read_array(1, &value) || *value < 0)
+			return false;
+		*cnt = *value;
+		return true;
+	}
+
+	bool read_array(int cnt, const int32_t **array) {
+		if (cnt < 0 || (length - position) / sizeof(int32_t) < (uint64_t) cnt)
+			return false;
+		*array = (const int32_t*) (payload + position);
+		position += cnt * sizeof(int32_t);
+		return true;
+	}
+
+	// Offsets into the following arrays must ascend from 0.
+	bool read_offsets(int cnt, const int32_t **offsets) {
+		if (!read_array(cnt + 1, offsets) || (*offsets)[0] != 0)
+			return false;
+		for (int i = 0; i < cnt; i++)
+			if ((*offsets)[i + 1] < (*offsets)[i])
+				return false;
+		return true;
+	}
+
+private:
+	const char *payload;
+	uint64_t length, position = 0;
+};
+
+bool MappedGaloisFile::open(const string &path, string *error) {
+	close();
+	data = map_file(path, &size, error);
+	if (data == nullptr)
+		return false;
+
+	const char *bytes = (const char*) data;
+	uint32_t header[2];
+	if (size < sizeof(MAGIC) + sizeof(header) || memcmp(bytes, MAGIC, sizeof(MAGIC)) != 0) {
+		*error = "not a binary Galois mesh file";
+		return false;
+	}
+	memcpy(header, bytes + sizeof(MAGIC), sizeof(header));
+	if (header[0] != GALOIS_FORMAT_VERSION || header[1] != SECTION_CNT) {
+		*error = "unsupported format version " + to_string(header[0]);
+		return false;
+	}
+
+	uint64_t position = sizeof(MAGIC) + sizeof(header);
+	bool ok = true;
+	for (int s = 0; s < SECTION_CNT && ok; s++) {
+		uint64_t length;
+		if (size - position < 16 || memcmp(bytes + position, SECTION_TAGS[s], 4) != 0) {
+			*error = "missing section " + string(SECTION_TAGS[s], 4);
+			return false;
+		}
+		memcpy(&length, bytes + position + 8, sizeof(length));
+		position += 16;
+		if (size - position < length) {
+			*error = "truncated section " + string(SECTION_TAGS[s], 4);
+			return false;
+		}
+		SectionReader reader(bytes + position, length);
+		position += length;
+
+		GaloisMeshView &v = view;
+		if (s == 0) {
+			ok = reader.read_count(&v.bspline_cnt)
+					&& reader.read_array(v.bspline_cnt, &v.bspline_ids)
+					&& reader.read_array(v.bspline_cnt, &v.bspline_flags);
+		} else if (s == 1) {
+			ok = reader.read_count(&v.element_cnt)
+					&& reader.read_array(v.element_cnt, &v.element_levels)
+					&& reader.read_array(v.element_cnt, &v.element_ids)
+					&& reader.read_offsets(v.element_cnt, &v.element_bspline_offsets)
+					&& reader.read_array(v.element_bspline_offsets[v.element_cnt], &v.element_bsplines);
+		} else {
+			ok = reader.read_count(&v.node_cnt)
+					&& reader.read_array(v.node_cnt, &v.node_ids)
+					&& reader.read_offsets(v.node_cnt, &v.node_element_offsets)
+					&& reader.read_array(v.node_element_offsets[v.node_cnt], &v.node_element_levels)
+					&& reader.read_array(v.node_element_offsets[v.node_cnt], &v.node_element_ids)
+					&& reader.read_offsets(v.node_cnt, &v.node_child_offsets)
+					&& reader.read_array(v.node_child_offsets[v.node_cnt], &v.node_children);
+		}
+		if (!ok)
+			*error = "malformed section " + string(SECTION_TAGS[s], 4);
+	}
+	return ok;
+}
+
+void MappedGaloisFile::close() {
+	if (data != nullptr)
+		munmap(data, size);
+	data = nullptr;
+	size = 0;
+	view = GaloisMeshView();
+}
+
+MappedGaloisFile::~MappedGaloisFile() {
+	close();
+}
+
+
+/*** VALIDATION ***/
+
+static bool fail(string *error, const string &reason) {
+	*error = reason;
+	return false;
+}
+
+bool GaloisMeshView::validate(string *error) const {
+	vector<bool> seen(bspline_cnt, false);
+	for (int i = 0; i < bspline_cnt; i++) {
+		int32_t id = bspline_ids[i];
+		if (id < 1 || id > bspline_cnt || seen[id - 1])
+			return fail(error, "B-spline " + to_string(i + 1) + " has a duplicate or out of range id " + to_string(id));
+		seen[id - 1] = true;
+	}
+
+	unordered_map<uint64_t, int> elements_by_key(element_cnt);
+	for (int i = 0; i < element_cnt; i++) {
+		if (!elements_by_key.emplace(element_key(element_levels[i], element_ids[i]), i).second)
+			return fail(error, "element " + to_string(element_levels[i]) + " " + to_string(element_ids[i])
+					+ " is listed twice");
+		for (int k = element_bspline_offsets[i]; k < element_bspline_offsets[i + 1]; k++)
+			if (element_bsplines[k] < 1 || element_bsplines[k] > bspline_cnt)
+				return fail(error, "element " + to_string(element_levels[i]) + " " + to_string(element_ids[i])
+						+ " refers to B-spline " + to_string(element_bsplines[k]) + " out of range");
+	}
+
+	if (node_cnt == 0)
+		return fail(error, "the tree has no nodes");
+	// Node positions by id, then parents by position.
+	vector<int> nodes_by_id(node_cnt, -1), parents(node_cnt, -1);
+	for (int i = 0; i < node_cnt; i++) {
+		int32_t id = node_ids[i];
+		if (id < 1 || id > node_cnt || nodes_by_id[id - 1] != -1)
+			return fail(error, "tree node " + to_string(i + 1) + " has a duplicate or out of range id " + to_string(id));
+		nodes_by_id[id - 1] = i;
+	}
+	for (int i = 0; i < node_cnt; i++) {
+		int child_cnt = node_child_offsets[i + 1] - node_child_offsets[i];
+		int node_element_cnt = node_element_offsets[i + 1] - node_element_offsets[i];
+		if (child_cnt != (node_element_cnt > 1 ? 2 : 0))
+			return fail(error, "non-binary tree node " + to_string(node_ids[i]) + ": " + to_string(node_element_cnt)
+					+ " elements, " + to_string(child_cnt) + " children");
+		int element_sum = 0;
+		for (int k = node_child_offsets[i]; k < node_child_offsets[i + 1]; k++) {
+			int32_t child_id = node_children[k];
+			int child = child_id < 1 || child_id > node_cnt ? -1 : nodes_by_id[child_id - 1];
+			if (child == -1)
+				return fail(error, "tree node " + to_string(node_ids[i]) + " has an undefined child " + to_string(child_id));
+			if (parents[child] != -1 || child == i)
+				return fail(error, "tree node " + to_string(child_id) + " is used as a child more than once");
+			parents[child] = i;
+			element_sum += node_element_offsets[child + 1] - node_element_offsets[child];
+		}
+		// Children split their parent's elements between them.
+		if (child_cnt > 0 && element_sum != node_element_cnt)
+			return fail(error, "non-binary tree node " + to_string(node_ids[i]) + ": its " + to_string(node_element_cnt)
+					+ " elements are not split between its two children");
+		for (int k = node_element_offsets[i]; k < node_element_offsets[i + 1]; k++)
+			if (elements_by_key.find(element_key(node_element_levels[k], node_element_ids[k])) == elements_by_key.end())
+				return fail(error, "tree node " + to_string(node_ids[i]) + " refers to an undefined element "
+						+ to_string(node_element_levels[k]) + " " + to_string(node_element_ids[k]));
+	}
+
+	int root = -1;
+	for (int i = 0; i < node_cnt; i++) {
+		if (parents[i] != -1)
+			continue;
+		if (root != -1)
+			return fail(error, "tree nodes " + to_string(node_ids[root]) + " and " + to_string(node_ids[i])
+					+ " both have no parent");
+		root = i;
+	}
+	if (root == -1)
+		return fail(error, "the tree has no root");
+
+	// With a single parent per node, a walk from the root reaches every node
+	// exactly once unless some of them form a cycle apart from it.
+	int reached_cnt = 0;
+	vector<bool> element_reached(element_cnt, false);
+	vector<int> stack = { root };
+	while (!stack.empty()) {
+		int node = stack.back();
+		stack.pop_back();
+		reached_cnt++;
+		for (int k = node_element_offsets[node]; k < node_element_offsets[node + 1]; k++)
+			element_reached[elements_by_key[element_key(node_element_levels[k], node_element_ids[k])]] = true;
+		for (int k = node_child_offsets[node]; k < node_child_offsets[node + 1]; k++)
+			stack.push_back(nodes_by_id[node_children[k] - 1]);
+	}
+	if (reached_cnt != node_cnt)
+		return fail(error, to_string(node_cnt - reached_cnt) + " tree nodes are not reachable from the root");
+	for (int i = 0; i < element_cnt; i++)
+		if (!element_reached[i])
+			return fail(error, "element " + to_string(element_levels[i]) + " " + to_string(element_ids[i])
+					+ " is not within the tree");
+	return true;
+}
@@ -0,0 +1,129 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_GALOISFORMAT_H
+#define BSPLINE_SINGULARITIES_GALOIS_GALOISFORMAT_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The Galois solver's input: B-splines, the B-splines covering each element
+// and the elimination tree, as printed by `generate --galois'. All the ids
+// are those of the text format, counting from 1; elements are identified by
+// their (level, id within level) pairs.
+//
+// The text format is a sequence of whitespace-separated numbers, in which
+// line breaks mean nothing:
+//
+//   bspline_cnt, then per B-spline: id flag
+//   element_cnt, then per element: level id bspline_cnt bsplines...
+//   node_cnt, then per tree node: id element_cnt (level id)... children...
+//
+// The children of tree nodes are not counted: the tree is assumed to be
+// binary, a node with more than one element having exactly two children and
+// any other one none. A writer breaking this makes the rest of the file
+// misparse, so text can only hold such trees; validate() checks that the
+// children of each node also split its elements between them.
+//
+// The binary format holds the same numbers as 32-bit integers of the host's
+// byte order, laid out so that they can be used straight from a mapped file:
+//
+//   "GALOISBN", uint32 version (1), uint32 section count (3)
+//   then per section: 4-byte tag, 4 bytes of padding, uint64 payload length
+//   in bytes, and the payload padded with zeros to a multiple of 8 bytes.
+//
+//   "BSPL": cnt, ids[cnt], flags[cnt]
+//   "ELEM": cnt, levels[cnt], ids[cnt], bspline_offsets[cnt + 1],
+//           bsplines[bspline_offsets[cnt]]
+//   "TREE": cnt, ids[cnt], element_offsets[cnt + 1],
+//           element_levels[element_offsets[cnt]],
+//           element_ids[element_offsets[cnt]], child_offsets[cnt + 1],
+//           children[child_offsets[cnt]]
+//
+// Lists of the element (or node) i are at positions offsets[i] up to
+// offsets[i + 1] of the arrays following the offsets.
+
+const uint32_t GALOIS_FORMAT_VERSION = 1;
+
+// Read-only arrays of a mesh, wherever they are stored.
+struct GaloisMeshView {
+	int bspline_cnt = 0;
+	const int32_t *bspline_ids = nullptr, *bspline_flags = nullptr;
+
+	int element_cnt = 0;
+	const int32_t *element_levels = nullptr, *element_ids = nullptr;
+	const int32_t *element_bspline_offsets = nullptr, *element_bsplines = nullptr;
+
+	int node_cnt = 0;
+	const int32_t *node_ids = nullptr, *node_element_offsets = nullptr;
+	const int32_t *node_element_levels = nullptr, *node_element_ids = nullptr;
+	const int32_t *node_child_offsets = nullptr, *node_children = nullptr;
+
+	// Prints the mesh in the text format, as `generate --galois' does.
+	void print_text(ostream &out) const;
+
+	void write_binary(ostream &out) const;
+
+	// Checks in linear time that the ids are in range and not repeated, that
+	// all the B-splines, elements and children referred to are defined, and
+	// that the tree has a single root from which every node and element can
+	// be reached. It must also be binary, as the text format needs: each node
+	// with more than one element has two children splitting its elements
+	// between them, and the others have none. Puts the first problem found
+	// into `error'.
+	bool validate(string *error) const;
+};
+
+// A mesh held in vectors, to be filled in and then viewed.
+struct GaloisMesh {
+	vector<int32_t> bspline_ids, bspline_flags;
+
+	vector<int32_t> element_levels, element_ids;
+	vector<int32_t> element_bspline_offsets = { 0 }, element_bsplines;
+
+	vector<int32_t> node_ids;
+	vector<int32_t> node_element_offsets = { 0 }, node_element_levels, node_element_ids;
+	vector<int32_t> node_child_offsets = { 0 }, node_children;
+
+	GaloisMeshView get_view() const;
+
+	// Parses the text format, skipping comments (from `#' up to the end of
+	// the line). Returns false if the input ends too early or holds anything
+	// else, putting the record and line at which it stopped into `error'.
+	bool read_text(const char *text, size_t size, string *error);
+
+	// Parses a text file mapped into memory.
+	bool read_text_file(const string &path, string *error);
+};
+
+// A binary mesh file mapped into memory, viewed in place.
+class MappedGaloisFile {
+public:
+
+	MappedGaloisFile() {}
+
+	MappedGaloisFile(const MappedGaloisFile&) = delete;
+
+	MappedGaloisFile& operator=(const MappedGaloisFile&) = delete;
+
+	~MappedGaloisFile();
+
+	// Maps the file and checks its structure, putting the reason into
+	// `error' if it fails.
+	bool open(const string &path, string *error);
+
+	const GaloisMeshView &get_view() const {
+		return view;
+	}
+
+private:
+
+	void close();
+
+	void *data = nullptr;
+	size_t size = 0;
+	GaloisMeshView view;
+};
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_GALOISFORMAT_H
@@ -0,0 +1,46 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+#include "galois-format.h"
+
+// Checks the consistency of a mesh in either the text or the binary format,
+// telling them apart by the binary format's magic.
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		cerr << "usage: " << argv[0] << " FILE" << endl;
+		return 1;
+	}
+	string path(argv[1]);
+
+	char magic[8] = { 0 };
+	ifstream(path, ios::binary).read(magic, sizeof(magic));
+	bool binary = memcmp(magic, "GALOISBN", sizeof(magic)) == 0;
+
+	GaloisMesh mesh;
+	MappedGaloisFile file;
+	GaloisMeshView view;
+	string error;
+	if (binary) {
+		if (!file.open(path, &error)) {
+			cerr << error << endl;
+			return 1;
+		}
+		view = file.get_view();
+	} else {
+		if (!mesh.read_text_file(path, &error)) {
+			cerr << error << endl;
+			return 1;
+		}
+		view = mesh.get_view();
+	}
+
+	if (!view.validate(&error)) {
+		cerr << path << ": " << error << endl;
+		return 1;
+	}
+	cout << path << ": " << view.bspline_cnt << " B-splines, " << view.element_cnt << " elements, "
+		<< view.node_cnt << " tree nodes" << endl;
+	return 0;
+}
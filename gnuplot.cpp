@@ -1,8 +1,12 @@
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
 #include "gnuplot.h"
+#include "mesh.h"
+#include "parallel.h"
 
 using namespace std;
 
@@ -13,17 +17,132 @@ double interpolate(double from, double to, int index, int interval_cnt) {
 	return from + (to - from) / interval_cnt * index;
 }
 
+void Function2D::apply_batch(const double* xs, const double* ys, double* out, int cnt) const {
+	for (int i = 0; i < cnt; i++)
+		out[i] = apply(xs[i], ys[i]);
+}
+
+void Function2D::apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const {
+	vector<double> row_xs(y_cnt);
+	for (int xi = 0; xi < x_cnt; xi++) {
+		fill(row_xs.begin(), row_xs.end(), xs[xi]);
+		apply_batch(row_xs.data(), ys, out + xi * y_cnt, y_cnt);
+	}
+}
+
+// Step of the central differences relative to the coordinate, about the fourth
+// root of the machine epsilon, which balances the truncation and rounding
+// errors of the second differences.
+static const double DIFFERENCE_STEP = 1e-4;
+
+void Function2D::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const {
+	for (int i = 0; i < cnt; i++) {
+		double x = xs[i], y = ys[i];
+		double hx = DIFFERENCE_STEP * max(1.0, fabs(x)), hy = DIFFERENCE_STEP * max(1.0, fabs(y));
+		double center = apply(x, y);
+		double left = apply(x - hx, y), right = apply(x + hx, y);
+		double down = apply(x, y - hy), up = apply(x, y + hy);
+		double diagonal = apply(x + hx, y + hy) - apply(x + hx, y - hy)
+				- apply(x - hx, y + hy) + apply(x - hx, y - hy);
+		out[i].value = center;
+		out[i].dx = (right - left) / (2 * hx);
+		out[i].dy = (up - down) / (2 * hy);
+		out[i].dxx = (right - 2 * center + left) / (hx * hx);
+		out[i].dxy = diagonal / (4 * hx * hy);
+		out[i].dyy = (up - 2 * center + down) / (hy * hy);
+	}
+}
+
+Derivatives Function2D::apply_derivatives(double x, double y) const {
+	Derivatives result;
+	apply_derivatives_batch(&x, &y, &result, 1);
+	return result;
+}
+
+void zero_derivatives_batch(const Rect& rect, bool inside, const double* xs, const double* ys, Derivatives* out,
+		int cnt) {
+	for (int i = 0; i < cnt; i++) {
+		bool in_rect = rect.x_from <= xs[i] && xs[i] <= rect.x_to && rect.y_from <= ys[i] && ys[i] <= rect.y_to;
+		if (in_rect == inside)
+			out[i] = ZERO_DERIVATIVES;
+	}
+}
+
+void sample_axes_2d(const Rect& area, int sample_cnt, vector<double>* xs, vector<double>* ys) {
+	int interval_cnt = sample_cnt - 1;
+	xs->resize(sample_cnt);
+	ys->resize(sample_cnt);
+	for (int i = 0; i < sample_cnt; i++) {
+		(*xs)[i] = interpolate(area.x_from, area.x_to, i, interval_cnt);
+		(*ys)[i] = interpolate(area.y_from, area.y_to, i, interval_cnt);
+	}
+}
+
 double samples_2d(const Function2D& f, const Rect& area, const string &data_file, int sample_cnt) {
+	vector<double> xs, ys, vals((size_t) sample_cnt * sample_cnt);
+	sample_axes_2d(area, sample_cnt, &xs, &ys);
+	f.apply_grid(xs.data(), sample_cnt, ys.data(), sample_cnt, vals.data());
+	//cerr << "samples2d: " << support.left() << " " << support.right() << " " << support.up() << " " << support.down() << endl;
+	return print_samples_2d(xs, ys, vals, data_file);
+}
+
+// Number of values which samples_2d_binary evaluates at a time per thread, in
+// tiles of whole rows, so that its buffers stay small next to the matrix.
+static const int TILE_VALUE_CNT = 1 << 16;
+
+// Rows of the matrix are written as they are computed: the first one holds the
+// number of columns and the y coordinates, each next one an x coordinate and
+// the values at (x, y) for all the ys.
+double samples_2d_binary(const Function2D& f, const Rect& area, const string &data_file, int sample_cnt,
+		int thread_cnt) {
+	if (sample_cnt <= 0)
+		return 0.0;
+	vector<double> xs, ys;
+	sample_axes_2d(area, sample_cnt, &xs, &ys);
+	size_t row_size = (size_t) sample_cnt + 1;
+	vector<float> matrix(row_size * row_size);
+	matrix[0] = sample_cnt;
+	for (int yi = 0; yi < sample_cnt; yi++)
+		matrix[1 + yi] = ys[yi];
+
+	int tile_row_cnt = max(1, TILE_VALUE_CNT / sample_cnt);
+	int tile_cnt = (sample_cnt - 1) / tile_row_cnt + 1;
+	// Maxima of the rows, reduced once all of them are done.
+	vector<double> row_maxes(sample_cnt, 0.0);
+	parallel_for(tile_cnt, thread_cnt, [&](int tile_from, int tile_to) {
+		vector<double> vals((size_t) tile_row_cnt * sample_cnt);
+		for (int tile = tile_from; tile < tile_to; tile++) {
+			int from = tile * tile_row_cnt, to = min(sample_cnt, from + tile_row_cnt);
+			f.apply_grid(xs.data() + from, to - from, ys.data(), sample_cnt, vals.data());
+			for (int xi = from; xi < to; xi++) {
+				float* row = &matrix[(xi + 1) * row_size];
+				const double* row_vals = &vals[(size_t) (xi - from) * sample_cnt];
+				row[0] = xs[xi];
+				for (int yi = 0; yi < sample_cnt; yi++) {
+					row[1 + yi] = row_vals[yi];
+					row_maxes[xi] = max(row_maxes[xi], row_vals[yi]);
+				}
+			}
+		}
+	});
+
+	ofstream fout(data_file, ios::binary);
+	fout.write((const char*) matrix.data(), matrix.size() * sizeof(float));
+	fout.close();
+	return *max_element(row_maxes.begin(), row_maxes.end());
+}
+
+double print_samples_2d(const vector<double>& xs, const vector<double>& ys, const vector<double>& vals,
+		const string &data_file) {
 	double max = 0.0;
 	ofstream fout(data_file);
-	int interval_cnt = sample_cnt - 1;
-	//cerr << "samples2d: " << support.left() << " " << support.right() << " " << support.up() << " " << support.down() << endl;
-	for (int xi = 0; xi < sample_cnt; xi++) {
-		double x = interpolate(area.x_from, area.x_to, xi, interval_cnt);
+	int sample_cnt = ys.size();
+	for (unsigned xi = 0; xi < xs.size(); xi++) {
+		double x = xs[xi];
 		for (int yi = 0; yi < sample_cnt; yi++) {
-			double y = interpolate(area.y_from, area.y_to, yi, interval_cnt);
+			double y = ys[yi];
 
-			double val = f.apply(x, y);
+			double val = vals[xi * sample_cnt + yi];
 			if (val > max) max = val;
 			fout << x << " " << y << " " << val << endl;
 			//cerr << x << " " << y << " " << val << endl;
@@ -79,26 +198,17 @@ void print_grid_rect(int left, int up, int right, int down, bool highlight) {
 	print_grid_line(left,  down, left,  up,   highlight);
 }
 
+// The same mesh as that of `generate --draw-plain <depth>'.
 int generate_and_render_grid(int depth) {
-	string d = to_string(depth);
-	string grid_file = "grid-" + d + ".dat";
-	string cmd = "./generate --draw-plain " + d + " > " + grid_file;
-	system(cmd.c_str());
-	ifstream fin(grid_file);
-
-	int N; // number of elements
-	fin >> N;
-	vector<Bounds> bs;
+	Coord grid_size = 2L << depth;
+	Domain domain(get_outmost_box(grid_size, QUADRATIC));
+	build_adapted_mesh(domain, EDGED_4, QUADRATIC, depth, grid_size);
+
 	int size = 0;
-	for (int i = 0; i < N; i++) {
-		Bounds b;
-		fin >> b.left >> b.right >> b.up >> b.down;
-		bs.push_back(b);
-		size = max(size, max(b.right, b.down));
-	}
-	for (int i = 0; i < N; i++) {
-		const Bounds& b = bs[i];
-		int left = b.left, right = b.right, up = b.up, down = b.down;
+	for (const Cube& e: domain.get_elements())
+		size = max(size, (int) max(e.right(), e.down()));
+	for (const Cube& e: domain.get_elements()) {
+		int left = e.left(), right = e.right(), up = e.up(), down = e.down();
 		if (left == right && up == down)
 			continue;  // skip vertices
 		bool hl = left == right || up == down;  // highlight double edges
@@ -110,9 +220,10 @@ int generate_and_render_grid(int depth) {
 	return size;
 }
 
-void print_plot_command(const string& data_file, const string& color, bool replot) {
+void print_plot_command(const string& data_file, const string& color, bool replot, bool binary) {
 	// alternatively: with pm3d
-	cout << (replot ? ", " : "splot ") << "\"" << data_file << "\" with lines lc rgb '" << color << "'";
+	cout << (replot ? ", " : "splot ") << "\"" << data_file << "\"" << (binary ? " binary matrix" : "")
+		<< " with lines lc rgb '" << color << "'";
 }
 
 void print_pause() {
@@ -8,9 +8,46 @@
 
 /*** Function sampling ***/
 
+// Value of a function at a point, together with its first and second
+// partial derivatives there.
+struct Derivatives {
+	double value, dx, dy, dxx, dxy, dyy;
+
+	void add_scaled(const Derivatives &other, double coef) {
+		value += other.value * coef;
+		dx += other.dx * coef;
+		dy += other.dy * coef;
+		dxx += other.dxx * coef;
+		dxy += other.dxy * coef;
+		dyy += other.dyy * coef;
+	}
+
+	bool is_zero() const {
+		return value == 0.0 && dx == 0.0 && dy == 0.0 && dxx == 0.0 && dxy == 0.0 && dyy == 0.0;
+	}
+};
+
+const Derivatives ZERO_DERIVATIVES = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+
 class Function2D {
 public:
 	virtual double apply(double x, double y) const = 0;
+
+	// Evaluates the function at each of the points (xs[i], ys[i]) into out[i],
+	// by default calling apply for each point.
+	virtual void apply_batch(const double* xs, const double* ys, double* out, int cnt) const;
+
+	// Evaluates the function at each point of the grid xs x ys into
+	// out[xi * y_cnt + yi], by default a row (fixed x) at a time.
+	virtual void apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const;
+
+	// Evaluates the function and its derivatives at each of the points
+	// (xs[i], ys[i]) into out[i], by default approximating the derivatives
+	// with central differences of apply, which are only accurate where the
+	// function is smooth around the point.
+	virtual void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
+	Derivatives apply_derivatives(double x, double y) const;
 };
 
 struct Rect {
@@ -25,14 +62,33 @@ struct Rect {
 	}
 };
 
+// Zeroes out[i] wherever (xs[i], ys[i]) lies outside (or, if `inside',
+// inside) of the closed rectangle.
+void zero_derivatives_batch(const Rect& rect, bool inside, const double* xs, const double* ys, Derivatives* out,
+		int cnt);
+
+// Coordinates of sample_cnt evenly spaced samples along each of the area's
+// dimensions, from its bounds inclusive.
+void sample_axes_2d(const Rect& area, int sample_cnt, vector<double>* xs, vector<double>* ys);
+
+// Samples the function at the grid of sample_axes_2d into the data file,
+// returning the greatest value.
 double samples_2d(const Function2D& f, const Rect& area, const string &data_file, int sample_cnt);
 
+// Like samples_2d, but evaluates tiles of a bounded number of rows of the grid
+// on up to thread_cnt threads and writes the samples as gnuplot's `binary
+// matrix' of float32 at once, for plots with print_plot_command(..., true).
+// The sample count must be below INT_MAX.
+double samples_2d_binary(const Function2D& f, const Rect& area, const string &data_file, int sample_cnt,
+		int thread_cnt);
 
-/*** Gnuplot script generation ***/
+// Writes values at the grid xs x ys, vals[xi * ys.size() + yi] being that at
+// (xs[xi], ys[yi]), into the data file, returning the greatest one.
+double print_samples_2d(const vector<double>& xs, const vector<double>& ys, const vector<double>& vals,
+		const string &data_file);
 
-struct Bounds {
-	int left, right, up, down;
-};
+
+/*** Gnuplot script generation ***/
 
 void print_config(int size, int sample_cnt);
 
@@ -47,7 +103,8 @@ void print_grid_rect(int left, int up, int right, int down, bool highlight);
 // Returns grid size.
 int generate_and_render_grid(int depth);
 
-void print_plot_command(const string& data_file, const string& color, bool replot);
+// A binary data file is one of samples_2d_binary.
+void print_plot_command(const string& data_file, const string& color, bool replot, bool binary = false);
 
 void print_pause();
 
@@ -1,6 +1,33 @@
 
+#include <algorithm>
+#include <cmath>
+#include "batch-kernels.h"
 #include "linear-combination.h"
 
+// With q = f / g: q' = (f' - q g') / g and q'' = (f'' - 2 q' g' - q g'') / g,
+// the mixed one being (f_xy - q_x g_y - q_y g_x - q g_xy) / g.
+Derivatives divide_derivatives(const Derivatives& f, const Derivatives& g) {
+	if (g.value == 0.0)
+		return ZERO_DERIVATIVES;
+	Derivatives q;
+	q.value = f.value / g.value;
+	q.dx = (f.dx - q.value * g.dx) / g.value;
+	q.dy = (f.dy - q.value * g.dy) / g.value;
+	q.dxx = (f.dxx - 2 * q.dx * g.dx - q.value * g.dxx) / g.value;
+	q.dxy = (f.dxy - q.dx * g.dy - q.dy * g.dx - q.value * g.dxy) / g.value;
+	q.dyy = (f.dyy - 2 * q.dy * g.dy - q.value * g.dyy) / g.value;
+	return q;
+}
+
+void LinearFunction::apply_batch(const double* xs, const double* ys, double* out, int cnt) const {
+	linear_batch(a, b, c, xs, ys, out, cnt);
+}
+
+void LinearFunction::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const {
+	for (int i = 0; i < cnt; i++)
+		out[i] = { a * xs[i] + b * ys[i] + c, a, b, 0.0, 0.0, 0.0 };
+}
+
 double LinearCombination::apply(double x, double y) const {
 	double result = 0.0;
 	for (unsigned i = 0; i < funs.size(); i++)
@@ -8,13 +35,232 @@ double LinearCombination::apply(double x, double y) const {
 	return result;
 }
 
+void LinearCombination::apply_batch(const double* xs, const double* ys, double* out, int cnt) const {
+	double values[BATCH_SIZE];
+	for (int from = 0; from < cnt; from += BATCH_SIZE) {
+		int batch_cnt = min(BATCH_SIZE, cnt - from);
+		fill(out + from, out + from + batch_cnt, 0.0);
+		for (unsigned i = 0; i < funs.size(); i++) {
+			funs[i]->apply_batch(xs + from, ys + from, values, batch_cnt);
+			add_scaled_batch(values, coefs[i], out + from, batch_cnt);
+		}
+	}
+}
+
+// The terms are added up in the same order as in apply, and add_scaled_batch
+// does not fuse them, so each point gets the value apply gives it.
+void LinearCombination::apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const {
+	int cnt = x_cnt * y_cnt;
+	vector<double> values(cnt);
+	fill(out, out + cnt, 0.0);
+	for (unsigned i = 0; i < funs.size(); i++) {
+		funs[i]->apply_grid(xs, x_cnt, ys, y_cnt, values.data());
+		add_scaled_batch(values.data(), coefs[i], out, cnt);
+	}
+}
+
+void LinearCombination::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const {
+	Derivatives values[BATCH_SIZE];
+	for (int from = 0; from < cnt; from += BATCH_SIZE) {
+		int batch_cnt = min(BATCH_SIZE, cnt - from);
+		fill(out + from, out + from + batch_cnt, ZERO_DERIVATIVES);
+		for (unsigned i = 0; i < funs.size(); i++) {
+			funs[i]->apply_derivatives_batch(xs + from, ys + from, values, batch_cnt);
+			for (int k = 0; k < batch_cnt; k++)
+				out[from + k].add_scaled(values[k], coefs[i]);
+		}
+	}
+}
+
 double Quotient::apply(double x, double y) const {
 	double divisor_value = divisor.apply(x, y);
 	return divisor_value != 0.0 ? dividend.apply(x, y) / divisor_value : 0.0;
 }
+
+void Quotient::apply_batch(const double* xs, const double* ys, double* out, int cnt) const {
+	double dividend_values[BATCH_SIZE], divisor_values[BATCH_SIZE];
+	for (int from = 0; from < cnt; from += BATCH_SIZE) {
+		int batch_cnt = min(BATCH_SIZE, cnt - from);
+		dividend.apply_batch(xs + from, ys + from, dividend_values, batch_cnt);
+		divisor.apply_batch(xs + from, ys + from, divisor_values, batch_cnt);
+		quotient_batch(dividend_values, divisor_values, out + from, batch_cnt);
+	}
+}
+void Quotient::apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const {
+	int cnt = x_cnt * y_cnt;
+	vector<double> dividend_values(cnt), divisor_values(cnt);
+	dividend.apply_grid(xs, x_cnt, ys, y_cnt, dividend_values.data());
+	divisor.apply_grid(xs, x_cnt, ys, y_cnt, divisor_values.data());
+	quotient_batch(dividend_values.data(), divisor_values.data(), out, cnt);
+}
+void Quotient::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const {
+	Derivatives dividend_values[BATCH_SIZE], divisor_values[BATCH_SIZE];
+	for (int from = 0; from < cnt; from += BATCH_SIZE) {
+		int batch_cnt = min(BATCH_SIZE, cnt - from);
+		dividend.apply_derivatives_batch(xs + from, ys + from, dividend_values, batch_cnt);
+		divisor.apply_derivatives_batch(xs + from, ys + from, divisor_values, batch_cnt);
+		for (int k = 0; k < batch_cnt; k++)
+			out[from + k] = divide_derivatives(dividend_values[k], divisor_values[k]);
+	}
+}
 double ZeroOutside::apply(double x, double y) const {
 	if (area.x_from <= x && x <= area.x_to && area.y_from <= y && y <= area.y_to)
 		return fun->apply(x, y);
 	else
 		return 0.0;
 }
+
+void ZeroOutside::apply_batch(const double* xs, const double* ys, double* out, int cnt) const {
+	fun->apply_batch(xs, ys, out, cnt);
+	zero_rect_batch(area.x_from, area.x_to, area.y_from, area.y_to, false, xs, ys, out, cnt);
+}
+
+void ZeroOutside::apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const {
+	fun->apply_grid(xs, x_cnt, ys, y_cnt, out);
+	zero_rect_grid(area.x_from, area.x_to, area.y_from, area.y_to, false, xs, x_cnt, ys, y_cnt, out);
+}
+
+void ZeroOutside::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const {
+	fun->apply_derivatives_batch(xs, ys, out, cnt);
+	zero_derivatives_batch(area, false, xs, ys, out, cnt);
+}
+
+/*** SUPPORT LOOKUP ***/
+
+SupportGrid::SupportGrid(const vector<Rect>& supports):
+		bounding_box(0, 0, 0, 0) {
+	if (!supports.empty())
+		bounding_box = supports[0];
+	for (const Rect& s: supports) {
+		bounding_box.x_from = min(bounding_box.x_from, s.x_from);
+		bounding_box.x_to = max(bounding_box.x_to, s.x_to);
+		bounding_box.y_from = min(bounding_box.y_from, s.y_from);
+		bounding_box.y_to = max(bounding_box.y_to, s.y_to);
+	}
+	// About one function per cell if the supports were spread evenly.
+	cells_per_dim = max(1, (int) ceil(sqrt((double) supports.size())));
+	cell_width = (bounding_box.x_to - bounding_box.x_from) / cells_per_dim;
+	cell_height = (bounding_box.y_to - bounding_box.y_from) / cells_per_dim;
+
+	// Two passes over the supports: count the functions of each cell, then
+	// fill them in.
+	int cell_cnt = cells_per_dim * cells_per_dim;
+	cell_offsets.assign(cell_cnt + 1, 0);
+	for (int pass = 0; pass < 2; pass++) {
+		vector<int> filled(cell_offsets.begin(), cell_offsets.end() - 1);
+		for (unsigned i = 0; i < supports.size(); i++) {
+			const Rect& s = supports[i];
+			int cx_from = get_cell(s.x_from, bounding_box.x_from, cell_width);
+			int cx_to = get_cell(s.x_to, bounding_box.x_from, cell_width);
+			int cy_from = get_cell(s.y_from, bounding_box.y_from, cell_height);
+			int cy_to = get_cell(s.y_to, bounding_box.y_from, cell_height);
+			for (int cx = cx_from; cx <= cx_to; cx++)
+				for (int cy = cy_from; cy <= cy_to; cy++) {
+					int c = cx * cells_per_dim + cy;
+					if (pass == 0)
+						cell_offsets[c + 1]++;
+					else
+						cell_funs[filled[c]++] = i;
+				}
+		}
+		if (pass == 0) {
+			for (int c = 0; c < cell_cnt; c++)
+				cell_offsets[c + 1] += cell_offsets[c];
+			cell_funs.resize(cell_offsets[cell_cnt]);
+		}
+	}
+}
+
+// Since the computation is monotone in `coord', a point within a support
+// always falls into one of the cells the support was put into.
+int SupportGrid::get_cell(double coord, double from, double cell_size) const {
+	if (!(cell_size > 0))
+		return 0;
+	double cell = floor((coord - from) / cell_size);
+	return (int) max(0.0, min((double) cells_per_dim - 1, cell));
+}
+
+void SupportGrid::locate(double x, double y, const int** begin, const int** end) const {
+	*begin = *end = cell_funs.data();
+	if (x < bounding_box.x_from || bounding_box.x_to < x || y < bounding_box.y_from || bounding_box.y_to < y)
+		return;
+	int c = get_cell(x, bounding_box.x_from, cell_width) * cells_per_dim
+			+ get_cell(y, bounding_box.y_from, cell_height);
+	*begin = cell_funs.data() + cell_offsets[c];
+	*end = cell_funs.data() + cell_offsets[c + 1];
+}
+
+
+/*** CULLED LINEAR COMBINATION ***/
+
+CulledLinearCombination::CulledLinearCombination(const vector<Function2D*>& _funs, const vector<Rect>& _supports,
+		const vector<double>& _coefs, const SupportLocator* _locator):
+		funs(_funs), supports(_supports), coefs(_coefs),
+		grid(_locator == nullptr ? _supports : vector<Rect>()),
+		locator(_locator) {
+}
+
+void CulledLinearCombination::find_candidates(double x, double y, vector<int>* found) const {
+	const int *begin, *end;
+	get_locator().locate(x, y, &begin, &end);
+	found->assign(begin, end);
+}
+
+// Functions are zero outside of their supports, and adding zeros does not
+// change the sum, so skipping them leaves the result exactly the same.
+double CulledLinearCombination::apply(double x, double y) const {
+	double result = 0.0;
+	const int *begin, *end;
+	get_locator().locate(x, y, &begin, &end);
+	for (const int* i = begin; i != end; i++)
+		result += funs[*i]->apply(x, y) * coefs[*i];
+	return result;
+}
+
+// Each function is evaluated over the part of the grid within its support,
+// its values added to those points in the same order as in apply.
+void CulledLinearCombination::apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const {
+	fill(out, out + x_cnt * y_cnt, 0.0);
+	vector<int> x_indices, y_indices;
+	vector<double> sub_xs, sub_ys, values;
+	for (unsigned i = 0; i < funs.size(); i++) {
+		const Rect& s = supports[i];
+		x_indices.clear();
+		sub_xs.clear();
+		for (int xi = 0; xi < x_cnt; xi++)
+			if (s.x_from <= xs[xi] && xs[xi] <= s.x_to) {
+				x_indices.push_back(xi);
+				sub_xs.push_back(xs[xi]);
+			}
+		y_indices.clear();
+		sub_ys.clear();
+		for (int yi = 0; yi < y_cnt; yi++)
+			if (s.y_from <= ys[yi] && ys[yi] <= s.y_to) {
+				y_indices.push_back(yi);
+				sub_ys.push_back(ys[yi]);
+			}
+		if (x_indices.empty() || y_indices.empty())
+			continue;
+
+		int sub_y_cnt = y_indices.size();
+		values.resize(x_indices.size() * sub_y_cnt);
+		funs[i]->apply_grid(sub_xs.data(), x_indices.size(), sub_ys.data(), sub_y_cnt, values.data());
+		for (unsigned sxi = 0; sxi < x_indices.size(); sxi++)
+			for (int syi = 0; syi < sub_y_cnt; syi++)
+				out[x_indices[sxi] * y_cnt + y_indices[syi]] += values[sxi * sub_y_cnt + syi] * coefs[i];
+	}
+}
+
+void CulledLinearCombination::apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out,
+		int cnt) const {
+	for (int p = 0; p < cnt; p++) {
+		out[p] = ZERO_DERIVATIVES;
+		const int *begin, *end;
+		get_locator().locate(xs[p], ys[p], &begin, &end);
+		for (const int* i = begin; i != end; i++) {
+			Derivatives value;
+			funs[*i]->apply_derivatives_batch(&xs[p], &ys[p], &value, 1);
+			out[p].add_scaled(value, coefs[*i]);
+		}
+	}
+}
@@ -4,6 +4,9 @@
 
 #include "gnuplot.h"
 
+// Derivatives of f / g, by the quotient rule, or zeros where g is 0.
+Derivatives divide_derivatives(const Derivatives& f, const Derivatives& g);
+
 class LinearFunction: public Function2D {
 public:
 	LinearFunction(double _a, double _b, double _c):
@@ -14,6 +17,10 @@ public:
 		return a * x + b * y + c;
 	}
 
+	void apply_batch(const double* xs, const double* ys, double* out, int cnt) const;
+
+	void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
 private:
 	double a, b, c;
 };
@@ -26,6 +33,12 @@ public:
 
 	double apply(double x, double y) const;
 
+	void apply_batch(const double* xs, const double* ys, double* out, int cnt) const;
+
+	void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
+	void apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const;
+
 private:
 	const Function2D* fun;
 	Rect area;
@@ -39,6 +52,12 @@ public:
 
 	double apply(double x, double y) const;
 
+	void apply_batch(const double* xs, const double* ys, double* out, int cnt) const;
+
+	void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
+	void apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const;
+
 protected:
 	const Function2D &dividend, &divisor;
 };
@@ -55,9 +74,91 @@ public:
 
     double apply(double x, double y) const;
 
+    void apply_batch(const double* xs, const double* ys, double* out, int cnt) const;
+
+    void apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const;
+
+    void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
 private:
     vector<Function2D*> funs;
 	vector<double> coefs;
 };
 
+// Finds out of a fixed list of functions those which may be nonzero at
+// a point.
+class SupportLocator {
+public:
+	virtual ~SupportLocator() {}
+
+	// Positions of the functions which may be nonzero at the point (all of
+	// those whose supports contain it, and maybe some more), in ascending
+	// order, as the range from *begin up to *end.
+	virtual void locate(double x, double y, const int** begin, const int** end) const = 0;
+};
+
+// Functions' (closed) supports bucketed into a uniform grid of cells over
+// their bounding box, each cell listing all the functions whose supports
+// reach into it.
+class SupportGrid : public SupportLocator {
+public:
+	SupportGrid(const vector<Rect>& supports);
+
+	void locate(double x, double y, const int** begin, const int** end) const;
+
+private:
+	int get_cell(double coord, double from, double cell_size) const;
+
+	// Cell (cx, cy) lists cell_funs[cell_offsets[c]..cell_offsets[c+1]) where
+	// c = cx * cells_per_dim + cy.
+	Rect bounding_box;
+	int cells_per_dim;
+	double cell_width, cell_height;
+	vector<int> cell_offsets, cell_funs;
+};
+
+// A linear combination of functions each of which is zero outside of the
+// given (closed) support, where only the functions which the locator finds
+// at a point are evaluated there; unless given another one, that is
+// a SupportGrid of the supports. The result is exactly that of
+// LinearCombination.
+class CulledLinearCombination : public Function2D {
+public:
+	CulledLinearCombination(const vector<Function2D*>& _funs, const vector<Rect>& _supports):
+		CulledLinearCombination(_funs, _supports, vector<double>(_funs.size(), 1.0)) {
+	}
+
+	CulledLinearCombination(const vector<Function2D*>& _funs, const vector<Rect>& _supports,
+			const vector<double>& _coefs, const SupportLocator* _locator = nullptr);
+
+	double apply(double x, double y) const;
+
+	void apply_grid(const double* xs, int x_cnt, const double* ys, int y_cnt, double* out) const;
+
+	void apply_derivatives_batch(const double* xs, const double* ys, Derivatives* out, int cnt) const;
+
+	// Positions of the functions which may be nonzero at the point, in
+	// ascending order.
+	void find_candidates(double x, double y, vector<int>* found) const;
+
+	const Function2D& get_function(int index) const {
+		return *funs[index];
+	}
+
+	double get_coef(int index) const {
+		return coefs[index];
+	}
+
+private:
+	const SupportLocator& get_locator() const {
+		return locator != nullptr ? *locator : grid;
+	}
+
+	vector<Function2D*> funs;
+	vector<Rect> supports;
+	vector<double> coefs;
+	SupportGrid grid;
+	const SupportLocator* locator;
+};
+
 #endif // BSPLINE_SINGULARITIES_GALOIS_LINEARCOMBINATION_H
@@ -0,0 +1,221 @@
+#include "mesh.h"
+
+using namespace std;
+
+
+/*** BOXES ***/
+
+Cube get_outmost_box(Coord size, MeshShape shape) {
+	if (shape == QUADRATIC)
+		return Cube(0, size, 0, size);
+	else // shape == RECTANGULAR
+		return Cube(0, (Coord) (1.5 * size), 0, size);
+}
+
+static Cube get_inner_box(Coord middle, Coord edge_offset) {
+	return Cube(middle - edge_offset, middle + edge_offset,
+				middle - edge_offset, middle + edge_offset);
+}
+
+static Cube get_inner_box(const Cube& outer_box, Coord edge_offset) {
+	return Cube(outer_box.get_bound(0) + edge_offset, outer_box.get_bound(1) - edge_offset,
+				outer_box.get_bound(2) + edge_offset, outer_box.get_bound(3) - edge_offset);
+}
+
+// Part of the outmost box of a rectangular mesh which is left after the
+// refinement.
+static Cube get_rectangular_mesh_box(const Cube& outmost_box, Coord size) {
+	return Cube(outmost_box.get_bound(0) + size / 2, outmost_box.get_bound(1) - size / 2,
+				outmost_box.get_bound(2), outmost_box.get_bound(3));
+}
+
+
+/*** MESH ***/
+
+void build_adapted_mesh(Domain &domain, MeshType mesh_type, MeshShape mesh_shape, int depth, Coord size) {
+	Cube outmost_box(get_outmost_box(size, mesh_shape));
+	Coord middle = size / 2;
+	Coord edge_offset = size / 4;
+	Cube outer_box = outmost_box;
+
+	// Build a regular 4x4 grid.
+	if (mesh_shape == QUADRATIC) {
+		domain.split_all_elements_into_4_2D();  // 1 -> 4 elements (2x2)
+		domain.split_all_elements_into_4_2D();  // 4 -> 16 elements (4x4)
+		if (mesh_type == EDGED_8 && depth > 1)
+			domain.split_eight_side_elements_within_box_2D(outmost_box);
+
+		// Generate the adapted grid.
+		for (int i = 1; i < depth; i++) {
+			Cube inner_box(get_inner_box(middle, edge_offset));
+
+			if (mesh_type == EDGED_4 || mesh_type == EDGED_8) {
+				bool edged_8 = mesh_type == EDGED_8;
+				domain.add_edge_2D(X_DIM, outer_box, inner_box.up(), 4, edged_8);  // horizontal
+				domain.add_edge_2D(X_DIM, outer_box, inner_box.down(), 4, edged_8);
+				domain.add_edge_2D(Y_DIM, outer_box, inner_box.left(), 4, edged_8);  // vertical
+				domain.add_edge_2D(Y_DIM, outer_box, inner_box.right(), 4, edged_8);
+				domain.add_corner_vertices_2D(inner_box);
+			}
+
+			// Internal 4 elements -> 16 elements
+			domain.split_elements_within_box_into_4_2D(inner_box);
+			if (mesh_type == EDGED_8 && i < depth - 1)
+				domain.split_eight_side_elements_within_box_2D(inner_box);
+
+			edge_offset /= 2;
+			outer_box = inner_box;
+		}
+	} else if (mesh_shape == RECTANGULAR) {
+		//build rectangular mesh, 4x6 grid (edge)
+		domain.split_all_elements_into_6_2D();  // 1 -> 6 elements (2x3)
+		domain.split_all_elements_into_4_2D();  // 4 -> 24 elements (4x6)
+
+		// Generate the adapted grid.
+		int cnt = 6;
+		for (int i = 1; i < depth; i++) {
+			Cube inner_box(get_inner_box(outer_box, edge_offset));
+			domain.add_edge_2D(X_DIM, outer_box, inner_box.up(), cnt, false);  // horizontal
+			domain.add_edge_2D(X_DIM, outer_box, inner_box.down(), cnt, false);
+			domain.add_edge_2D(Y_DIM, outer_box, inner_box.left(), 4, false);  // vertical
+			domain.add_edge_2D(Y_DIM, outer_box, inner_box.right(), 4, false);
+			domain.add_corner_vertices_2D(inner_box);
+
+			//Split internal elements
+			domain.split_elements_within_box_into_4_2D(inner_box);
+			cnt = (cnt - 2) * 2;
+			edge_offset /= 2;
+			outer_box = inner_box;
+		}
+
+		outer_box = get_rectangular_mesh_box(outmost_box, size);
+
+		domain.remove_all_elements_not_contained_in(outer_box);
+	}
+
+	domain.allocate_elements_count_by_level_vector(depth);
+	domain.enumerate_all_elements();
+	domain.tweak_bounds();
+	domain.compute_all_neighbors(size);
+	domain.untweak_bounds();
+}
+
+
+/*** ELIMINATION TREE ***/
+
+static void decompose_alternating_dimensions(Domain &domain, Node *parent, Cube outer_box, Coord offset, int lvl = 0) {
+	int elements_cnt = domain.count_elements_within_box(outer_box);
+	Cube first_box, second_box;
+	Node *current_outer_node = domain.add_tree_node(outer_box, parent);
+	//we have a regular recantuglar mesh now, with two cut_off_boxes
+	if (2 * outer_box.get_size(0) == outer_box.get_size(1) && elements_cnt != 2) {
+		Cube third_box, fourth_box;
+
+		outer_box.split(Y_DIM, outer_box.get_bound(2) + offset, &first_box, &second_box);
+		Node *second_node = domain.add_tree_node(second_box, current_outer_node);
+
+		decompose_alternating_dimensions(domain, current_outer_node, first_box, offset, lvl + 1);
+
+		second_box.split(Y_DIM, second_box.get_bound(3) - offset, &third_box, &fourth_box);
+
+		decompose_alternating_dimensions(domain, second_node, third_box, offset, lvl + 1);
+		decompose_alternating_dimensions(domain, second_node, fourth_box, offset, lvl + 1);
+		domain.finish_tree_node(second_node);
+	} else if (outer_box.get_size(0) == outer_box.get_size(1) && elements_cnt != 1) {
+		//quadratic element, needs to be split into halves
+
+		outer_box.split_halves(X_DIM, &first_box, &second_box);
+		decompose_alternating_dimensions(domain, current_outer_node, first_box, offset / 2, lvl + 1);
+		decompose_alternating_dimensions(domain, current_outer_node, second_box, offset / 2, lvl + 1);
+	} else if (elements_cnt == 2) {
+		//cut_off box, only 2 leaves inside
+		if (outer_box.get_size(0) == 2) {
+			outer_box.split_halves(Y_DIM, &first_box, &second_box);
+		} else {
+			outer_box.split_halves(X_DIM, &first_box, &second_box);
+
+		};
+		domain.finish_tree_node(domain.add_tree_node(first_box, current_outer_node));
+		domain.finish_tree_node(domain.add_tree_node(second_box, current_outer_node));
+	}
+	//domain.print_tree_nodes_count();
+	domain.finish_tree_node(current_outer_node);
+}
+
+void build_elimination_tree(Domain &domain, MeshShape mesh_shape, int depth, Coord size) {
+	Cube outmost_box(get_outmost_box(size, mesh_shape));
+	Coord edge_offset = size / 4;
+	Cube outer_box;
+
+	if (mesh_shape == QUADRATIC) {
+		outer_box = outmost_box;
+
+		Node *outer_node = domain.add_tree_node(outer_box, NULL);
+		Node *side_node;
+		// Each outer node is finished only after all the nested ones.
+		vector<Node*> outer_nodes = { outer_node };
+		// Generate elimination tree.
+		for (int i = 1; i < depth; i++) {
+			//cout << "looping" << endl;
+			Cube inner_box(get_inner_box(outer_box, edge_offset));
+			Cube side_box, main_box;
+
+			outer_box.split(X_DIM, inner_box.left(), &side_box, &main_box);
+			side_node = domain.add_tree_node(side_box, outer_node);
+			domain.tree_process_cut_off_box(Y_DIM, side_node, false);
+			outer_node = domain.add_tree_node(main_box, outer_node);
+			outer_nodes.push_back(outer_node);
+			outer_box = main_box;
+			domain.tree_process_box_2D(side_box);
+
+			outer_box.split(X_DIM, inner_box.right(), &main_box, &side_box);
+			side_node = domain.add_tree_node(side_box, outer_node);
+			outer_node = domain.add_tree_node(main_box, outer_node);
+			outer_nodes.push_back(outer_node);
+			domain.tree_process_cut_off_box(Y_DIM, side_node, false);
+			outer_box = main_box;
+			domain.tree_process_box_2D(side_box);
+
+			outer_box.split(Y_DIM, inner_box.up(), &side_box, &main_box);
+			side_node = domain.add_tree_node(side_box, outer_node);
+			outer_node = domain.add_tree_node(main_box, outer_node);
+			outer_nodes.push_back(outer_node);
+			domain.tree_process_cut_off_box(X_DIM, side_node, false);
+			outer_box = main_box;
+			domain.tree_process_box_2D(side_box);
+
+			outer_box.split(Y_DIM, inner_box.down(), &main_box, &side_box);
+			side_node = domain.add_tree_node(side_box, outer_node);
+			outer_node = domain.add_tree_node(main_box, outer_node);
+			outer_nodes.push_back(outer_node);
+			domain.tree_process_cut_off_box(X_DIM, side_node, false);
+			outer_box = main_box;
+			domain.tree_process_box_2D(side_box);
+
+			edge_offset /= 2;
+		}
+		// The innermost 16 elements are processed at the very end.
+		domain.tree_process_cut_off_box(X_DIM, outer_node, true);
+		outer_nodes.pop_back();
+		while (!outer_nodes.empty()) {
+			domain.finish_tree_node(outer_nodes.back());
+			outer_nodes.pop_back();
+		}
+	} else {
+
+		// Recursively decompose the remaining rectangular
+		outer_box = get_rectangular_mesh_box(outmost_box, size);
+		decompose_alternating_dimensions(domain, NULL, outer_box, edge_offset);
+
+	}
+}
+
+void stream_elimination_tree(Domain &domain, MeshShape mesh_shape, int depth, Coord size) {
+	domain.set_tree_output(COUNT_TREE);
+	build_elimination_tree(domain, mesh_shape, depth, size);
+	domain.print_tree_nodes_count();
+
+	domain.set_tree_output(STREAM_TREE);
+	build_elimination_tree(domain, mesh_shape, depth, size);
+	domain.set_tree_output(STORE_TREE);
+}
@@ -0,0 +1,23 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_MESH_H
+#define BSPLINE_SINGULARITIES_GALOIS_MESH_H
+
+#include "domain.h"
+
+// Box of the whole domain of the given size (its extent along y).
+Cube get_outmost_box(Coord size, MeshShape shape);
+
+// Refines the domain, spanning get_outmost_box(size, mesh_shape), into the
+// mesh adapted towards its middle up to the given depth, then enumerates its
+// elements and computes their neighbors.
+void build_adapted_mesh(Domain &domain, MeshType mesh_type, MeshShape mesh_shape, int depth, Coord size);
+
+// Builds the elimination tree over the mesh of build_adapted_mesh.
+void build_elimination_tree(Domain &domain, MeshShape mesh_shape, int depth, Coord size);
+
+// Prints the elimination tree's section of the Galois output without keeping
+// the tree: a first pass only counts the nodes, then the second one prints
+// each node once its subtree is finished (so in postorder rather than by
+// number) and frees its children.
+void stream_elimination_tree(Domain &domain, MeshShape mesh_shape, int depth, Coord size);
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_MESH_H
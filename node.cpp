@@ -1,4 +1,3 @@
-#include <iostream>
 #include "cube.h"
 #include "vector"
 #include "node.h"
@@ -28,7 +27,7 @@ int Node::get_num() const {
 	return num;
 }
 
-void Node::print_num() const {
-	cout << get_num() + 1 << " ";
+void Node::print_num(TextWriter &out) const {
+	out << get_num() + 1 << " ";
 }
 
@@ -22,7 +22,7 @@ public:
 
 	int get_num() const;
 
-	void print_num() const;
+	void print_num(TextWriter &out) const;
 
 private:
 
@@ -0,0 +1,24 @@
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+using namespace std;
+
+void parallel_for(int cnt, int thread_cnt, const function<void(int from, int to)> &body) {
+	if (thread_cnt > cnt)
+		thread_cnt = cnt;
+	if (thread_cnt <= 1) {
+		body(0, cnt);
+		return;
+	}
+	auto chunk_from = [cnt, thread_cnt](int chunk_no) {
+		return (int) ((long) cnt * chunk_no / thread_cnt);
+	};
+	vector<thread> threads;
+	for (int i = 1; i < thread_cnt; i++)
+		threads.push_back(thread(body, chunk_from(i), chunk_from(i + 1)));
+	body(0, chunk_from(1));
+	for (auto& t: threads)
+		t.join();
+}
@@ -0,0 +1,14 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_PARALLEL_H
+#define BSPLINE_SINGULARITIES_GALOIS_PARALLEL_H
+
+#include <functional>
+
+using namespace std;
+
+// Calls `body' on consecutive chunks of [0, cnt), each chunk on its own
+// thread out of at most `thread_cnt', and waits for all of them. Chunks
+// depend only on `cnt' and `thread_cnt', so results written per index are
+// deterministic.
+void parallel_for(int cnt, int thread_cnt, const function<void(int from, int to)> &body);
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_PARALLEL_H
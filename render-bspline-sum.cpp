@@ -1,6 +1,8 @@
 
 #include <climits>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
 using namespace std;
 
 #include "gnuplot.h"
@@ -18,19 +20,47 @@ int main(int argc, char** argv) {
 	if (argc == 1 || string(argv[1]) == "-s") 
 		output = SCREEN;
 
+	// Given a sample count, the sum is sampled in parallel into a binary file.
+	bool binary = argc >= 3;
+	int sample_cnt = SAMPLE_CNT;
+	if (binary) {
+		char* end;
+		long cnt = strtol(argv[2], &end, 10);
+		// The binary matrix has a row and a column more than the samples.
+		if (*argv[2] == '\0' || *end != '\0' || cnt < 2 || cnt >= INT_MAX) {
+			cerr << "usage: " << argv[0] << " <-s|eps-name> [sample-count from 2 to " << INT_MAX - 1 << "]" << endl;
+			return 1;
+		}
+		sample_cnt = cnt;
+	}
+
 	int size = generate_and_render_grid(3);
 
-	print_config(size, SAMPLE_CNT);
+	print_config(size, sample_cnt);
 	print_rotate_view(30, 45);
 	if (output == EPS)
 		print_eps_terminal(argv[1]);
 
 	NurbsOverAdaptedGrid nurbs(3);
-	LinearCombination sum_of_scaled(nurbs.get_all_bsplines());
-	string sum_file = "bspline_sum.dat";
 	Rect support(0, size, 0, size);
-	samples_2d(sum_of_scaled, support, sum_file, SAMPLE_CNT);
-	print_plot_command(sum_file, "red", false);
+	if (binary) {
+		string sum_file = "bspline_sum.bin";
+		samples_2d_binary(NurbsSum(nurbs), support, sum_file, sample_cnt, max(1u, thread::hardware_concurrency()));
+		print_plot_command(sum_file, "red", false, true);
+	} else {
+		string sum_file = "bspline_sum.dat";
+		// The sum at each sample is that of a row of the collocation matrix.
+		vector<double> xs, ys, point_xs, point_ys;
+		sample_axes_2d(support, SAMPLE_CNT, &xs, &ys);
+		for (double x: xs)
+			for (double y: ys) {
+				point_xs.push_back(x);
+				point_ys.push_back(y);
+			}
+		CsrMatrix collocation = nurbs.get_collocation_matrix(point_xs.data(), point_ys.data(), point_xs.size());
+		print_samples_2d(xs, ys, collocation.get_row_sums(), sum_file);
+		print_plot_command(sum_file, "red", false);
+	}
 
 	cout << endl;
 	if (output == SCREEN)
@@ -12,3 +12,29 @@ for opt in $opts; do
 	done
 done
 
+
+# Mass and stiffness matrices of the smaller meshes.
+for shape in $shapes; do
+	for depth in `seq 1 3`; do
+		echo "./generate --matrices -$shape $depth #matrices_depth-${depth}_$shape"
+	done
+done
+
+# The binary Galois output, converted back to text, must equal the text one.
+for shape in $shapes; do
+	for depth in `seq 1 3`; do
+		echo "./generate --galois-binary -$shape $depth > galois-binary.tmp && ./galois-convert --to-text galois-binary.tmp; rm -f galois-binary.tmp #galois-binary_depth-${depth}_$shape"
+		echo "./generate --galois-binary -$shape $depth > galois-binary.tmp && ./galois-validate galois-binary.tmp; rm -f galois-binary.tmp #galois-binary-valid_depth-${depth}_$shape"
+	done
+done
+
+# The streamed Galois output, and that it still makes up a valid mesh.
+for shape in $shapes; do
+	for depth in `seq 1 3`; do
+		echo "./generate --galois-streamed -$shape $depth #galois-streamed_depth-${depth}_$shape"
+		echo "./generate --galois-streamed -$shape $depth > galois-streamed.tmp && ./galois-validate galois-streamed.tmp; rm -f galois-streamed.tmp #galois-streamed-valid_depth-${depth}_$shape"
+	done
+done
+
+# Batch and grid evaluation must give exactly the values of the one-point one.
+echo "./check-batch #check-batch"
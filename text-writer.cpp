@@ -0,0 +1,91 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "text-writer.h"
+
+using namespace std;
+
+// Enough for any 64-bit integer with its sign.
+static const int MAX_INTEGER_LENGTH = 20;
+
+// Enough for any double printed with "%g" or "%.17g".
+static const int MAX_DOUBLE_LENGTH = 32;
+
+TextWriter::TextWriter(ostream &_target, size_t capacity):
+	target(_target), buffer(max(capacity, (size_t) MAX_DOUBLE_LENGTH)) {
+}
+
+TextWriter::~TextWriter() {
+	flush();
+}
+
+TextWriter& TextWriter::operator<<(const char *text) {
+	append(text, strlen(text));
+	return *this;
+}
+
+TextWriter& TextWriter::operator<<(const string &text) {
+	append(text.data(), text.size());
+	return *this;
+}
+
+TextWriter& TextWriter::operator<<(long long value) {
+	if (value >= 0)
+		return *this << (unsigned long long) value;
+	reserve(MAX_INTEGER_LENGTH);
+	buffer[size++] = '-';
+	// Negated in unsigned arithmetic so that the minimum does not overflow.
+	return *this << -(unsigned long long) value;
+}
+
+TextWriter& TextWriter::operator<<(unsigned long long value) {
+	reserve(MAX_INTEGER_LENGTH);
+	char digits[MAX_INTEGER_LENGTH];
+	int cnt = 0;
+	do {
+		digits[cnt++] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	while (cnt > 0)
+		buffer[size++] = digits[--cnt];
+	return *this;
+}
+
+TextWriter& TextWriter::operator<<(double value) {
+	reserve(MAX_DOUBLE_LENGTH);
+	size += snprintf(&buffer[size], MAX_DOUBLE_LENGTH, "%g", value);
+	return *this;
+}
+
+TextWriter& TextWriter::write_exact(double value) {
+	reserve(MAX_DOUBLE_LENGTH);
+	size += snprintf(&buffer[size], MAX_DOUBLE_LENGTH, "%.17g", value);
+	return *this;
+}
+
+void TextWriter::append(const char *text, size_t cnt) {
+	if (cnt > buffer.size()) {
+		write_out();
+		target.write(text, cnt);
+		return;
+	}
+	reserve(cnt);
+	memcpy(&buffer[size], text, cnt);
+	size += cnt;
+}
+
+void TextWriter::write_out() {
+	target.write(buffer.data(), size);
+	size = 0;
+}
+
+void TextWriter::flush() {
+	write_out();
+	target.flush();
+}
+
+TextWriter& standard_output() {
+	static TextWriter writer(cout);
+	return writer;
+}
@@ -0,0 +1,84 @@
+#ifndef BSPLINE_SINGULARITIES_GALOIS_TEXTWRITER_H
+#define BSPLINE_SINGULARITIES_GALOIS_TEXTWRITER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Formats text into a large buffer and hands it over to the target stream
+// only when the buffer fills up or on flush, instead of once per `<<' and
+// per `endl'. Integers are formatted by hand; doubles as `ostream' does by
+// default.
+class TextWriter {
+public:
+	static const size_t DEFAULT_CAPACITY = 1 << 20;
+
+	explicit TextWriter(ostream &_target, size_t capacity = DEFAULT_CAPACITY);
+
+	TextWriter(const TextWriter&) = delete;
+
+	TextWriter& operator=(const TextWriter&) = delete;
+
+	~TextWriter();
+
+	TextWriter& operator<<(char c) {
+		reserve(1);
+		buffer[size++] = c;
+		return *this;
+	}
+
+	TextWriter& operator<<(const char *text);
+
+	TextWriter& operator<<(const string &text);
+
+	TextWriter& operator<<(int value) {
+		return *this << (long long) value;
+	}
+
+	TextWriter& operator<<(unsigned value) {
+		return *this << (unsigned long long) value;
+	}
+
+	TextWriter& operator<<(long value) {
+		return *this << (long long) value;
+	}
+
+	TextWriter& operator<<(unsigned long value) {
+		return *this << (unsigned long long) value;
+	}
+
+	TextWriter& operator<<(long long value);
+
+	TextWriter& operator<<(unsigned long long value);
+
+	TextWriter& operator<<(double value);
+
+	// Writes the value with "%.17g", enough digits to read it back exactly.
+	TextWriter& write_exact(double value);
+
+	// Writes out the buffer and flushes the target stream.
+	void flush();
+
+private:
+
+	// Makes room for `cnt' more characters, writing out the buffer if needed.
+	void reserve(size_t cnt) {
+		if (buffer.size() - size < cnt)
+			write_out();
+	}
+
+	void write_out();
+
+	void append(const char *text, size_t cnt);
+
+	ostream &target;
+	vector<char> buffer;
+	size_t size = 0;
+};
+
+// The writer over `cout' used by default, flushed at exit.
+TextWriter& standard_output();
+
+#endif //BSPLINE_SINGULARITIES_GALOIS_TEXTWRITER_H